@@ -0,0 +1,381 @@
+#include "archive_source_tree.h"
+
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+
+#include <cstring>
+#include <stdexcept>
+
+#include <zlib.h>
+
+using namespace std;
+
+using google::protobuf::io::ArrayInputStream;
+using google::protobuf::io::CopyingInputStream;
+using google::protobuf::io::CopyingInputStreamAdaptor;
+using google::protobuf::io::ZeroCopyInputStream;
+
+namespace {
+
+// Size of the blocks handed to the parser, so that it can be stopped
+// between blocks without copying.
+const int stream_block_size = 64 * 1024;
+
+// Decompresses raw deflate data as it is read.
+class InflateInputStream : public CopyingInputStream
+{
+public:
+    InflateInputStream(const char * data, size_t size)
+    {
+        memset(&stream, 0, sizeof(stream));
+        valid = inflateInit2(&stream, -MAX_WBITS) == Z_OK;
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+        stream.avail_in = uInt(size);
+    }
+
+    ~InflateInputStream()
+    {
+        if (valid)
+            inflateEnd(&stream);
+    }
+
+    int Read(void * buffer, int size) override
+    {
+        if (!valid)
+            return -1;
+        if (done)
+            return 0;
+
+        stream.next_out = static_cast<Bytef*>(buffer);
+        stream.avail_out = uInt(size);
+
+        while (stream.avail_out == uInt(size))
+        {
+            int result = inflate(&stream, Z_NO_FLUSH);
+            if (result == Z_STREAM_END)
+            {
+                done = true;
+                break;
+            }
+            if (result != Z_OK)
+                return -1;
+        }
+
+        return size - int(stream.avail_out);
+    }
+
+private:
+    z_stream stream;
+    bool valid = false;
+    bool done = false;
+};
+
+bool ends_with(const string & text, const string & suffix)
+{
+    return text.size() >= suffix.size() and
+            text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+uint32_t read16(const char * data)
+{
+    auto * bytes = reinterpret_cast<const unsigned char*>(data);
+    return bytes[0] | bytes[1] << 8;
+}
+
+uint32_t read32(const char * data)
+{
+    auto * bytes = reinterpret_cast<const unsigned char*>(data);
+    return uint32_t(bytes[0]) | uint32_t(bytes[1]) << 8 | uint32_t(bytes[2]) << 16 | uint32_t(bytes[3]) << 24;
+}
+
+// A NUL-terminated string in a fixed-size field.
+string field_string(const char * data, size_t size)
+{
+    return string(data, strnlen(data, size));
+}
+
+// An octal number in a tar header, or a big-endian binary one
+// if the first byte has the high bit set.
+uint64_t tar_number(const char * data, size_t size)
+{
+    uint64_t value = 0;
+
+    if (static_cast<unsigned char>(data[0]) & 0x80)
+    {
+        value = static_cast<unsigned char>(data[0]) & 0x7f;
+        for (size_t i = 1; i < size; ++i)
+            value = value << 8 | static_cast<unsigned char>(data[i]);
+        return value;
+    }
+
+    for (size_t i = 0; i < size and data[i]; ++i)
+    {
+        if (data[i] >= '0' and data[i] <= '7')
+            value = value * 8 + (data[i] - '0');
+    }
+
+    return value;
+}
+
+// The "path" record of a pax extended header, if any.
+string pax_path(const char * data, size_t size)
+{
+    size_t position = 0;
+
+    while (position < size)
+    {
+        // "<length> <key>=<value>\n", where length counts the whole record.
+        size_t length = 0;
+        size_t i = position;
+        while (i < size and data[i] >= '0' and data[i] <= '9')
+            length = length * 10 + (data[i++] - '0');
+
+        if (length == 0 or position + length > size)
+            break;
+
+        string record(data + i + 1, position + length - i - 2);
+        if (record.compare(0, 5, "path=") == 0)
+            return record.substr(5);
+
+        position += length;
+    }
+
+    return "";
+}
+
+string normalized_name(string name)
+{
+    while (name.compare(0, 2, "./") == 0)
+        name.erase(0, 2);
+    return name;
+}
+
+}
+
+ArchiveSourceTree::ArchiveSourceTree(const string & path, const string & dir):
+    path(path),
+    dir(dir)
+{
+    while (!this->dir.empty() and this->dir.back() == '/')
+        this->dir.pop_back();
+
+    archive = MappedFile::open(path);
+    if (!archive)
+        throw std::runtime_error("Failed to open archive: " + path);
+
+    const char * data = archive->data();
+    size_t size = archive->size();
+
+    if (size >= 4 and (memcmp(data, "PK\x03\x04", 4) == 0 or memcmp(data, "PK\x05\x06", 4) == 0))
+    {
+        index_zip();
+    }
+    else if (size >= 2 and static_cast<unsigned char>(data[0]) == 0x1f and static_cast<unsigned char>(data[1]) == 0x8b)
+    {
+        index_tar_gzip();
+    }
+    else
+    {
+        base = data;
+        index_tar(data, size);
+    }
+}
+
+bool ArchiveSourceTree::is_archive(const string & path)
+{
+    return ends_with(path, ".tar") or ends_with(path, ".tar.gz") or
+            ends_with(path, ".tgz") or ends_with(path, ".zip");
+}
+
+void ArchiveSourceTree::index_tar(const char * data, size_t size)
+{
+    const size_t block_size = 512;
+    string long_name;
+    size_t offset = 0;
+
+    while (offset + block_size <= size)
+    {
+        const char * header = data + offset;
+
+        // The archive ends with zero blocks.
+        if (header[0] == '\0')
+            break;
+
+        string name = field_string(header, 100);
+        uint64_t member_size = tar_number(header + 124, 12);
+        char type = header[156];
+
+        if (memcmp(header + 257, "ustar", 5) == 0)
+        {
+            string prefix = field_string(header + 345, 155);
+            if (!prefix.empty())
+                name = prefix + "/" + name;
+        }
+
+        size_t member_offset = offset + block_size;
+        if (member_size > size - member_offset)
+            throw std::runtime_error("Truncated tar archive: " + path);
+
+        switch (type)
+        {
+        case 'L':
+            // GNU long name of the next member.
+            long_name = field_string(data + member_offset, member_size);
+            break;
+        case 'x':
+        {
+            string pax_name = pax_path(data + member_offset, member_size);
+            if (!pax_name.empty())
+                long_name = pax_name;
+            break;
+        }
+        case '0':
+        case '\0':
+        case '7':
+        {
+            Member member;
+            member.offset = member_offset;
+            member.size = member_size;
+            members[normalized_name(long_name.empty() ? name : long_name)] = member;
+            long_name.clear();
+            break;
+        }
+        default:
+            long_name.clear();
+        }
+
+        offset = member_offset + (member_size + block_size - 1) / block_size * block_size;
+    }
+}
+
+void ArchiveSourceTree::index_tar_gzip()
+{
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+
+    // Accept a gzip header only.
+    if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK)
+        throw std::runtime_error("Failed to decompress archive: " + path);
+
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(archive->data()));
+    stream.avail_in = uInt(archive->size());
+
+    char buffer[64 * 1024];
+    int result = Z_OK;
+
+    while (result != Z_STREAM_END or stream.avail_in > 0)
+    {
+        // A file may hold several concatenated gzip members.
+        if (result == Z_STREAM_END)
+            inflateReset(&stream);
+
+        stream.next_out = reinterpret_cast<Bytef*>(buffer);
+        stream.avail_out = sizeof(buffer);
+
+        result = inflate(&stream, Z_NO_FLUSH);
+        if (result != Z_OK and result != Z_STREAM_END)
+        {
+            inflateEnd(&stream);
+            throw std::runtime_error("Failed to decompress archive: " + path);
+        }
+
+        decompressed.append(buffer, sizeof(buffer) - stream.avail_out);
+    }
+
+    inflateEnd(&stream);
+
+    base = decompressed.data();
+    index_tar(decompressed.data(), decompressed.size());
+}
+
+void ArchiveSourceTree::index_zip()
+{
+    const char * data = archive->data();
+    size_t size = archive->size();
+
+    base = data;
+
+    // The end of central directory record is followed by a comment
+    // of at most 64 KiB.
+    const size_t end_size = 22;
+    if (size < end_size)
+        throw std::runtime_error("Invalid zip archive: " + path);
+
+    size_t end = size - end_size;
+    size_t end_limit = size > end_size + 0xffff ? size - end_size - 0xffff : 0;
+    while (read32(data + end) != 0x06054b50)
+    {
+        if (end == end_limit)
+            throw std::runtime_error("Invalid zip archive: " + path);
+        --end;
+    }
+
+    uint32_t entry_count = read16(data + end + 10);
+    size_t position = read32(data + end + 16);
+
+    for (uint32_t i = 0; i < entry_count; ++i)
+    {
+        const size_t entry_size = 46;
+        if (position + entry_size > size or read32(data + position) != 0x02014b50)
+            throw std::runtime_error("Invalid zip archive: " + path);
+
+        const char * entry = data + position;
+        uint32_t method = read16(entry + 10);
+        uint32_t compressed_size = read32(entry + 20);
+        uint32_t member_size = read32(entry + 24);
+        uint32_t name_length = read16(entry + 28);
+        uint32_t extra_length = read16(entry + 30);
+        uint32_t comment_length = read16(entry + 32);
+        size_t local_offset = read32(entry + 42);
+
+        if (position + entry_size + name_length > size)
+            throw std::runtime_error("Invalid zip archive: " + path);
+
+        string name(entry + entry_size, name_length);
+        position += entry_size + name_length + extra_length + comment_length;
+
+        if (name.empty() or name.back() == '/')
+            continue;
+
+        if (compressed_size == 0xffffffff or member_size == 0xffffffff or local_offset == 0xffffffff)
+            throw std::runtime_error("Zip64 archives are not supported: " + path);
+
+        if (method != 0 and method != 8)
+            continue;
+
+        // The data follows the local header, whose extra field may differ
+        // from the one in the central directory.
+        const size_t local_size = 30;
+        if (local_offset + local_size > size or read32(data + local_offset) != 0x04034b50)
+            throw std::runtime_error("Invalid zip archive: " + path);
+
+        Member member;
+        member.offset = local_offset + local_size + read16(data + local_offset + 26) + read16(data + local_offset + 28);
+        member.size = member_size;
+        member.compressed_size = compressed_size;
+        member.deflated = method == 8;
+
+        if (member.offset + compressed_size > size)
+            throw std::runtime_error("Truncated zip archive: " + path);
+
+        members[normalized_name(name)] = member;
+    }
+}
+
+ZeroCopyInputStream * ArchiveSourceTree::Open(const string & filename)
+{
+    auto member = members.find(dir.empty() ? filename : dir + "/" + filename);
+    if (member == members.end())
+    {
+        last_error = "File not found.";
+        return nullptr;
+    }
+
+    auto & info = member->second;
+
+    if (!info.deflated)
+        return new ArrayInputStream(base + info.offset, int(info.size), stream_block_size);
+
+    auto * stream = new CopyingInputStreamAdaptor(new InflateInputStream(base + info.offset, info.compressed_size));
+    stream->SetOwnsCopyingStream(true);
+    return stream;
+}
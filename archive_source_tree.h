@@ -0,0 +1,55 @@
+#pragma once
+
+#include "mapped_source_tree.h"
+
+#include <google/protobuf/compiler/importer.h>
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+
+// Files inside a tar, gzip-compressed tar or zip archive, under an optional
+// directory, read without extracting the archive.
+//
+// The archive is memory-mapped and indexed once, on construction.
+// Members of a tar or stored members of a zip are served directly from the
+// mapping; deflated zip members are decompressed as they are read.
+// A gzip-compressed tar can not be read at an offset, so its members are
+// decompressed once while indexing.
+
+class ArchiveSourceTree : public google::protobuf::compiler::SourceTree
+{
+public:
+    // Throws std::runtime_error if the archive can not be read.
+    ArchiveSourceTree(const std::string & path, const std::string & dir = "");
+
+    google::protobuf::io::ZeroCopyInputStream * Open(const std::string & filename) override;
+    std::string GetLastErrorMessage() override { return last_error; }
+
+    // Whether path names an archive of a supported kind, by its extension.
+    static bool is_archive(const std::string & path);
+
+private:
+    struct Member
+    {
+        uint64_t offset = 0;
+        uint64_t size = 0;
+        uint64_t compressed_size = 0;
+        bool deflated = false;
+    };
+
+    void index_tar(const char * data, size_t size);
+    void index_tar_gzip();
+    void index_zip();
+
+    std::string path;
+    std::string dir;
+    std::shared_ptr<const MappedFile> archive;
+    std::map<std::string, Member> members;
+    // Decompressed content of a gzip-compressed tar.
+    std::string decompressed;
+    // Start of the data that member offsets refer to.
+    const char * base = nullptr;
+    std::string last_error;
+};
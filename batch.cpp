@@ -0,0 +1,156 @@
+#include "batch.h"
+#include "source_cache.h"
+#include "thread_pool.h"
+#include "json/json.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+using nlohmann::json;
+using namespace std;
+
+namespace {
+
+struct Entry
+{
+    string dir1;
+    string file1;
+    string dir2;
+    string file2;
+    vector<string> selectors;
+    string output;
+
+    string report;
+    string error;
+};
+
+}
+
+static
+vector<Entry> read_manifest(const string & path)
+{
+    ifstream file(path);
+    if (!file.is_open())
+        throw std::runtime_error("Failed to open manifest: " + path);
+
+    vector<Entry> entries;
+
+    string line;
+    int line_number = 0;
+    while (getline(file, line))
+    {
+        ++line_number;
+
+        if (line.find_first_not_of(" \t\r") == string::npos)
+            continue;
+
+        try
+        {
+            auto object = json::parse(line);
+
+            Entry entry;
+            entry.dir1 = object.at("dir1").get<string>();
+            entry.file1 = object.at("file1").get<string>();
+            entry.dir2 = object.at("dir2").get<string>();
+            entry.file2 = object.at("file2").get<string>();
+
+            auto & type = object.at("type");
+            if (type.is_array())
+                entry.selectors = type.get<vector<string>>();
+            else
+                entry.selectors.push_back(type.get<string>());
+
+            if (object.count("output"))
+                entry.output = object["output"].get<string>();
+
+            entries.push_back(std::move(entry));
+        }
+        catch (json::exception & e)
+        {
+            throw std::runtime_error(path + ":" + to_string(line_number) + ": " + e.what());
+        }
+    }
+
+    return entries;
+}
+
+static
+void run_entry(Entry & entry, SourceCache & sources, const Comparison::Options & options)
+{
+    try
+    {
+        auto source1 = sources.get(entry.dir1, entry.file1);
+        auto source2 = sources.get(entry.dir2, entry.file2);
+
+        Comparison comparison(options);
+        comparison.run(*source1, *source2, entry.selectors);
+
+        ostringstream report;
+        comparison.root.print(report);
+        entry.report = report.str();
+    }
+    catch (std::exception & e)
+    {
+        entry.error = e.what();
+        return;
+    }
+
+    if (!entry.output.empty())
+    {
+        ofstream output(entry.output);
+        output << entry.report;
+        if (!output)
+            entry.error = "Failed to write report: " + entry.output;
+    }
+}
+
+int run_batch(const string & manifest_path, const Comparison::Options & options,
+              unsigned int thread_count)
+{
+    vector<Entry> entries;
+
+    try
+    {
+        entries = read_manifest(manifest_path);
+    }
+    catch (std::exception & e)
+    {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    SourceCache sources;
+
+    {
+        ThreadPool pool(thread_count);
+        for (auto & entry : entries)
+            pool.submit([&]{ run_entry(entry, sources, options); });
+        pool.wait();
+    }
+
+    int status = 0;
+
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        auto & entry = entries[i];
+
+        if (!entry.error.empty())
+        {
+            cerr << "Entry " << i + 1 << ": " << entry.error << endl;
+            status = 1;
+            continue;
+        }
+
+        if (entry.output.empty())
+        {
+            cout << "== " << entry.dir1 << " " << entry.file1 << " -> "
+                 << entry.dir2 << " " << entry.file2;
+            for (auto & selector : entry.selectors)
+                cout << " " << selector;
+            cout << '\n' << entry.report;
+        }
+    }
+
+    return status;
+}
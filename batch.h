@@ -0,0 +1,19 @@
+#pragma once
+
+#include "comparison.h"
+
+// Runs the comparisons listed in a manifest, one JSON object per line:
+//
+//     {"dir1": "v1", "file1": "a.proto", "dir2": "v2", "file2": "a.proto",
+//      "type": "corp.Msg", "output": "a.diff"}
+//
+// "type" is a selector as on the command line or an array of them.
+// "output" is optional: the report is written to that file, or else to
+// standard output after a header line, in manifest order.
+//
+// Each (dir, file) Source is loaded once and shared by all entries using it.
+// Comparisons run on a pool of thread_count threads (0 for one per core).
+//
+// Returns 0 if all comparisons succeeded, 1 otherwise.
+int run_batch(const string & manifest_path, const Comparison::Options & options,
+              unsigned int thread_count);
@@ -0,0 +1,56 @@
+#include "chain.h"
+
+#include <future>
+#include <iostream>
+
+using namespace std;
+
+int run_chain(const vector<pair<string, string>> & versions,
+              const vector<string> & selectors,
+              const Comparison::Options & options)
+{
+    auto load = [&](size_t index)
+    {
+        auto & version = versions[index];
+        return async(launch::async, [&version]
+        {
+            return make_shared<Source>(version.second, version.first);
+        });
+    };
+
+    future<shared_ptr<Source>> next = load(0);
+    shared_ptr<Source> previous;
+
+    for (size_t i = 0; i < versions.size(); ++i)
+    {
+        shared_ptr<Source> current;
+
+        try
+        {
+            current = next.get();
+        }
+        catch (std::exception & e)
+        {
+            cerr << versions[i].first << " " << versions[i].second << ": " << e.what() << endl;
+            return 1;
+        }
+
+        if (i + 1 < versions.size())
+            next = load(i + 1);
+
+        if (previous)
+        {
+            Comparison comparison(options);
+            comparison.run(*previous, *current, selectors);
+
+            cout << "== Step " << i << ": "
+                 << versions[i-1].first << " " << versions[i-1].second << " -> "
+                 << versions[i].first << " " << versions[i].second << '\n';
+            comparison.root.print();
+        }
+
+        previous = current;
+    }
+
+    return 0;
+}
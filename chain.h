@@ -0,0 +1,18 @@
+#pragma once
+
+#include "comparison.h"
+
+#include <utility>
+#include <vector>
+
+// Compares each version in an ordered list of (root directory, file)
+// versions with the next one, printing one report per step.
+//
+// Every version is loaded exactly once. Loading is pipelined with the
+// comparisons: version N+1 is loaded in the background while N-1 -> N is
+// being compared.
+//
+// Returns 0 on success, 1 if a version failed to load.
+int run_chain(const vector<std::pair<string, string>> & versions,
+              const vector<string> & selectors,
+              const Comparison::Options & options);
@@ -0,0 +1,74 @@
+#include "change_set.h"
+
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+using namespace std;
+
+using google::protobuf::FileDescriptor;
+
+ChangeSet ChangeSet::load(const string & path)
+{
+    ifstream file;
+    if (path != "-")
+    {
+        file.open(path);
+        if (!file.is_open())
+            throw std::runtime_error("Failed to open file: " + path);
+    }
+
+    istream & input = path == "-" ? cin : file;
+
+    ChangeSet changes;
+    string line;
+    while (getline(input, line))
+        changes.add(line);
+
+    return changes;
+}
+
+void ChangeSet::add(const string & path)
+{
+    size_t begin = path.find_first_not_of(" \t\r");
+    size_t end = path.find_last_not_of(" \t\r");
+    if (begin == string::npos)
+        return;
+
+    string trimmed = path.substr(begin, end - begin + 1);
+    while (trimmed.compare(0, 2, "./") == 0)
+        trimmed.erase(0, 2);
+
+    paths.insert(trimmed);
+}
+
+bool ChangeSet::contains(const string & file_name) const
+{
+    if (paths.count(file_name))
+        return true;
+
+    for (auto & path : paths)
+    {
+        if (path.size() > file_name.size() and
+                path[path.size() - file_name.size() - 1] == '/' and
+                path.compare(path.size() - file_name.size(), file_name.size(), file_name) == 0)
+            return true;
+    }
+
+    return false;
+}
+
+bool ChangeSet::affects(const FileDescriptor * file, unordered_map<const FileDescriptor*, bool> & memo) const
+{
+    auto known = memo.find(file);
+    if (known != memo.end())
+        return known->second;
+
+    // Imports do not form cycles.
+    bool affected = contains(file->name());
+    for (int i = 0; i < file->dependency_count() and !affected; ++i)
+        affected = affects(file->dependency(i), memo);
+
+    memo[file] = affected;
+    return affected;
+}
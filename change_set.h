@@ -0,0 +1,34 @@
+#pragma once
+
+#include <google/protobuf/descriptor.h>
+
+#include <set>
+#include <string>
+#include <unordered_map>
+
+// Paths of changed files, e.g. from "git diff --name-only".
+//
+// A changed path names a file of a source tree if it is equal to the file
+// name or ends with "/" followed by it, so paths relative to a repository
+// also match files of a source tree rooted in a subdirectory.
+
+class ChangeSet
+{
+public:
+    // Reads one path per line from a file, or from standard input if
+    // path is "-". Throws std::runtime_error if the file can not be read.
+    static ChangeSet load(const std::string & path);
+
+    void add(const std::string & path);
+    bool empty() const { return paths.empty(); }
+
+    bool contains(const std::string & file_name) const;
+
+    // Whether the file or any file it imports, directly or indirectly,
+    // is changed. Results are memoized in memo.
+    bool affects(const google::protobuf::FileDescriptor * file,
+                 std::unordered_map<const google::protobuf::FileDescriptor*, bool> & memo) const;
+
+private:
+    std::set<std::string> paths;
+};
@@ -1,7 +1,11 @@
 #include "comparison.h"
+#include "matching.h"
+#include "moves.h"
 
 #include <iostream>
 #include <string>
+#include <algorithm>
+#include <unordered_set>
 
 using namespace std;
 
@@ -56,9 +60,24 @@ string Comparison::Item::message() const
     case File_Enum_Removed:
         msg = "Enum removed";
         break;
+    case File_Message_Moved:
+        msg = "Message moved";
+        break;
+    case File_Enum_Moved:
+        msg = "Enum moved";
+        break;
+    case Rpc_Payload_Affected:
+        msg = "RPC payload affected";
+        break;
     case Name_Missing:
         msg = "Name missing";
         break;
+    case File_Added:
+        msg = "File added";
+        break;
+    case File_Removed:
+        msg = "File removed";
+        break;
     default:
         msg = "?";
         return msg;
@@ -90,6 +109,9 @@ string Comparison::Section::message() const
     case Enum_Value_Comparison:
         msg << "Comparing enum values: " << a << " -> " << b;
         break;
+    case File_Comparison:
+        msg << "Comparing files: " << a << " -> " << b;
+        break;
     default:
         msg << "?";
     }
@@ -134,7 +156,12 @@ void print_field(const FieldDescriptor * field)
 
 void Comparison::Section::print(int level)
 {
-    cout << string(level*2, ' ') << message() << endl;
+    print(cout, level);
+}
+
+void Comparison::Section::print(std::ostream & out, int level)
+{
+    out << string(level*2, ' ') << message() << '\n';
 
     ++level;
 
@@ -142,17 +169,17 @@ void Comparison::Section::print(int level)
 
     for (auto & note : notes)
     {
-        cout << subprefix << note << endl;
+        out << subprefix << note << '\n';
     }
 
     for (auto & item : items)
     {
-        cout << subprefix << "* " << item.message() << endl;
+        out << subprefix << "* " << item.message() << '\n';
     }
 
     for (auto & subsection : subsections)
     {
-        subsection.print(level);
+        subsection.print(out, level);
     }
 }
 
@@ -205,15 +232,18 @@ Comparison::Section * Comparison::compare(const EnumDescriptor * enum1, const En
     auto & section = root.add_subsection(Enum_Comparison, enum1->full_name(), enum2->full_name());
     compared.emplace(key, &section);
 
-    for (int i = 0; i < enum1->value_count(); ++i)
+    auto matching = options.binary ?
+                match_values_by_number(enum1, enum2) :
+                match_values_by_name(enum1, enum2);
+
+    for (int i = 0; i < enum1->value_count() and !stopped; ++i)
     {
         auto * value1 = enum1->value(i);
-        auto * value2 = options.binary ?
-                    enum2->FindValueByNumber(value1->number()) :
-                    enum2->FindValueByName(value1->name());
+        int j = matching.first_to_second[i];
 
-        if (value2)
+        if (j >= 0)
         {
+            auto * value2 = enum2->value(j);
             auto & subsection = section.add_subsection(Enum_Value_Comparison, value1->name(), value2->name());
 
             if (value1->number() != value2->number())
@@ -226,35 +256,34 @@ Comparison::Section * Comparison::compare(const EnumDescriptor * enum1, const En
                 subsection.add_item(Enum_Value_Name_Changed,
                                     value1->name(), value2->name());
             }
+            check_stop(subsection);
         }
         else
         {
             string value1_id = options.binary ? to_string(value1->number()) : value1->name();
             section.add_item(Enum_Value_Removed, value1_id, "");
+            check_stop(section);
         }
     }
 
-    for (int i = 0; i < enum2->value_count(); ++i)
+    for (int i = 0; i < enum2->value_count() and !stopped; ++i)
     {
-        auto * value2 = enum2->value(i);
-        auto * value1 = options.binary ?
-                    enum1->FindValueByNumber(value2->number()) :
-                    enum1->FindValueByName(value2->name());
-
-        if (!value1)
+        if (!matching.second_matched[i])
         {
+            auto * value2 = enum2->value(i);
             string value2_id = options.binary ? to_string(value2->number()) : value2->name();
             section.add_item(Enum_Value_Added, "", value2_id);
+            check_stop(section);
         }
     }
 
+    leave(enter(key, &section));
+
     return &section;
 }
 
-Comparison::Section Comparison::compare(const FieldDescriptor * field1, const FieldDescriptor * field2)
+void Comparison::compare(const FieldDescriptor * field1, const FieldDescriptor * field2, Section & section)
 {
-    Section section(Message_Field_Comparison, field1->name(), field2->name());
-
     if (field1->name() != field2->name())
     {
         section.add_item(Message_Field_Name_Changed, field1->name(), field2->name());
@@ -282,11 +311,8 @@ Comparison::Section Comparison::compare(const FieldDescriptor * field1, const Fi
         auto * type_comparison = compare(enum1, enum2);
         type_comparison->notes.push_back("Required by " + field1->full_name() + " -> " + field2->full_name());
 
-        type_comparison->trim();
-        if (!type_comparison->is_empty())
-        {
-            section.add_item(Message_Field_Type_Changed, enum1->full_name(), enum2->full_name());
-        }
+        depend_on(enum1->full_name() + ":" + enum2->full_name(), section,
+                  enum1->full_name(), enum2->full_name());
     }
     else if (field1->type() == FieldDescriptor::TYPE_MESSAGE)
     {
@@ -296,11 +322,8 @@ Comparison::Section Comparison::compare(const FieldDescriptor * field1, const Fi
         auto * type_comparison = compare(msg1, msg2);
         type_comparison->notes.push_back("Required by " + field1->full_name() + " -> " + field2->full_name());
 
-        type_comparison->trim();
-        if (!type_comparison->is_empty())
-        {
-            section.add_item(Message_Field_Type_Changed, msg1->full_name(), msg2->full_name());
-        }
+        depend_on(msg1->full_name() + ":" + msg2->full_name(), section,
+                  msg1->full_name(), msg2->full_name());
     }
 
     if (field1->cpp_type() == field2->cpp_type())
@@ -310,8 +333,6 @@ Comparison::Section Comparison::compare(const FieldDescriptor * field1, const Fi
             section.add_item(Message_Field_Default_Value_Changed, "", "");
         }
     }
-
-    return section;
 }
 
 Comparison::Section * Comparison::compare(const Descriptor * desc1, const Descriptor * desc2)
@@ -323,92 +344,217 @@ Comparison::Section * Comparison::compare(const Descriptor * desc1, const Descri
     auto & section = root.add_subsection(Message_Comparison, desc1->full_name(), desc2->full_name());
     compared.emplace(key, &section);
 
+    auto & node = enter(key, &section);
+    auto * parent = current;
+    current = &node;
+
+    auto matching = options.binary ?
+                match_fields_by_number(desc1, desc2) :
+                match_fields_by_name(desc1, desc2);
 
-    for (int i = 0; i < desc1->field_count(); ++i)
+    if (options.detect_renames and !options.binary)
+        pair_renamed_fields(desc1, desc2, matching, options.rename_similarity);
+
+    for (int i = 0; i < desc1->field_count() and !stopped; ++i)
     {
         auto * field1 = desc1->field(i);
-        auto * field2 = options.binary ?
-                    desc2->FindFieldByNumber(field1->number()) :
-                    desc2->FindFieldByName(field1->name());
+        int j = matching.first_to_second[i];
 
-        if (field2)
+        if (j >= 0)
         {
-            section.subsections.push_back(compare(field1, field2));
+            auto * field2 = desc2->field(j);
+            auto & subsection = section.add_subsection(Message_Field_Comparison, field1->name(), field2->name());
+            compare(field1, field2, subsection);
+            check_stop(subsection);
         }
         else
         {
             string field1_id = options.binary ? to_string(field1->number()) : field1->name();
             section.add_item(Message_Field_Removed, field1_id, "");
+            check_stop(section);
         }
     }
 
-    for (int i = 0; i < desc2->field_count(); ++i)
+    for (int i = 0; i < desc2->field_count() and !stopped; ++i)
     {
-        auto * field2 = desc2->field(i);
-        auto * field1 =  options.binary ?
-                    desc1->FindFieldByNumber(field2->number()) :
-                    desc1->FindFieldByName(field2->name());
-
-        if (!field1)
+        if (!matching.second_matched[i])
         {
+            auto * field2 = desc2->field(i);
             string field2_id = options.binary ? to_string(field2->number()) : field2->name();
             section.add_item(Message_Field_Added, "", field2_id);
+            check_stop(section);
         }
     }
 
+    current = parent;
+    leave(node);
+
     return &section;
 }
 
+Comparison::Node & Comparison::enter(const string & key, Section * section)
+{
+    auto & node = nodes[key];
+    node.index = node.lowlink = next_index++;
+    node.on_stack = true;
+    node.section = section;
+    stack.push_back(&node);
+    return node;
+}
+
+void Comparison::leave(Node & node)
+{
+    if (node.lowlink != node.index)
+        return;
+
+    // Node is the root of a strongly connected component,
+    // which consists of all the nodes above it on the stack.
+
+    auto first = stack.end();
+    do { --first; } while (*first != &node);
+
+    bool changed = false;
+    for (auto member = first; member != stack.end(); ++member)
+    {
+        changed |= (*member)->section->has_changes();
+    }
+
+    for (auto member = first; member != stack.end(); ++member)
+    {
+        (*member)->on_stack = false;
+        (*member)->changed = changed;
+
+        if (changed)
+        {
+            for (auto & dependency : (*member)->dependencies)
+            {
+                auto & items = dependency.section->items;
+                items.emplace(std::next(items.begin(), dependency.position),
+                              Message_Field_Type_Changed, dependency.a, dependency.b);
+            }
+        }
+
+        (*member)->dependencies.clear();
+    }
+
+    stack.erase(first, stack.end());
+}
+
+void Comparison::depend_on(const string & key, Section & section, const string & a, const string & b)
+{
+    auto & target = nodes.at(key);
+
+    if (target.on_stack and current)
+    {
+        current->lowlink = std::min(current->lowlink, target.lowlink);
+        current->dependencies.push_back({ &section, section.items.size(), a, b });
+    }
+    else if (target.changed)
+    {
+        section.add_item(Message_Field_Type_Changed, a, b);
+    }
+}
+
+void Comparison::check_stop(const Section & section)
+{
+    if (options.stop_at_first_difference and !section.items.empty())
+        stopped = true;
+}
+
 void Comparison::compare(Source & source1, Source & source2)
 {
     auto * file1 = source1.file_descriptor();
     auto * file2 = source2.file_descriptor();
 
-    for (int i = 0; i < file1->message_type_count(); ++i)
+    if (options.changed_files)
+    {
+        unordered_map<const google::protobuf::FileDescriptor*, bool> memo;
+        if (!options.changed_files->affects(file1, memo) and !options.changed_files->affects(file2, memo))
+            return;
+    }
+
+    TypeMoves moves;
+    if (options.detect_moves)
+        moves = find_moved_types(file1, file2, options.move_similarity, options.type_mapping.get());
+
+    auto * pool2 = source2.pool();
+    string name2;
+
+    unordered_set<const Descriptor*> matched_messages;
+    for (auto & move : moves.messages)
+        matched_messages.insert(move.second);
+
+    unordered_set<const EnumDescriptor*> matched_enums;
+    for (auto & move : moves.enums)
+        matched_enums.insert(move.second);
+
+    for (int i = 0; i < file1->message_type_count() and !stopped; ++i)
     {
         auto * msg1 = file1->message_type(i);
-        auto * msg2 = file2->FindMessageTypeByName(msg1->name());
+        auto * msg2 = options.type_mapping and options.type_mapping->map(msg1->full_name(), name2) ?
+                    pool2->FindMessageTypeByName(name2) :
+                    file2->FindMessageTypeByName(msg1->name());
         if (msg2)
         {
+            matched_messages.insert(msg2);
+            compare(msg1, msg2);
+        }
+        else if (moves.messages.count(msg1))
+        {
+            msg2 = moves.messages.at(msg1);
             compare(msg1, msg2);
+            root.add_item(File_Message_Moved, msg1->full_name(), msg2->full_name());
+            check_stop(root);
         }
         else
         {
             root.add_item(File_Message_Removed, msg1->full_name(), "");
+            check_stop(root);
         }
     }
 
-    for (int i = 0; i < file2->message_type_count(); ++i)
+    for (int i = 0; i < file2->message_type_count() and !stopped; ++i)
     {
         auto * msg2 = file2->message_type(i);
-        auto * msg1 = file1->FindMessageTypeByName(msg2->name());
-        if (!msg1)
+        if (!matched_messages.count(msg2))
         {
             root.add_item(File_Message_Added, "", msg2->full_name());
+            check_stop(root);
         }
     }
 
-    for (int i = 0; i < file1->enum_type_count(); ++i)
+    for (int i = 0; i < file1->enum_type_count() and !stopped; ++i)
     {
         auto * enum1 = file1->enum_type(i);
-        auto * enum2 = file2->FindEnumTypeByName(enum1->name());
+        auto * enum2 = options.type_mapping and options.type_mapping->map(enum1->full_name(), name2) ?
+                    pool2->FindEnumTypeByName(name2) :
+                    file2->FindEnumTypeByName(enum1->name());
         if (enum2)
         {
+            matched_enums.insert(enum2);
             compare(enum1, enum2);
         }
+        else if (moves.enums.count(enum1))
+        {
+            enum2 = moves.enums.at(enum1);
+            compare(enum1, enum2);
+            root.add_item(File_Enum_Moved, enum1->full_name(), enum2->full_name());
+            check_stop(root);
+        }
         else
         {
             root.add_item(File_Enum_Removed, enum1->full_name(), "");
+            check_stop(root);
         }
     }
 
-    for (int i = 0; i < file2->enum_type_count(); ++i)
+    for (int i = 0; i < file2->enum_type_count() and !stopped; ++i)
     {
         auto * enum2 = file2->enum_type(i);
-        auto * enum1 = file1->FindEnumTypeByName(enum2->name());
-        if (!enum1)
+        if (!matched_enums.count(enum2))
         {
             root.add_item(File_Enum_Added, "", enum2->full_name());
+            check_stop(root);
         }
     }
 }
@@ -433,6 +579,143 @@ void Comparison::compare(Source & source1, const string & name1, Source & source
     else
     {
         root.add_item(Name_Missing, name1, name2);
+        check_stop(root);
     }
 }
 
+
+void Comparison::report_impact(Source & source1, Source & source2)
+{
+    root.trim();
+
+    auto & index1 = source1.impact_index();
+    auto & index2 = source2.impact_index();
+
+    for (auto & section : root.subsections)
+    {
+        if (section.type != Message_Comparison and section.type != Enum_Comparison)
+            continue;
+
+        auto roots1 = index1.affected_roots(section.a);
+        auto roots2 = index2.affected_roots(section.b);
+
+        unordered_map<string, bool> payloads2;
+        for (auto * root2 : roots2)
+        {
+            if (root2->rpc_payload)
+                payloads2.emplace(root2->name, false);
+        }
+
+        for (auto * root1 : roots1)
+        {
+            if (!root1->rpc_payload)
+                continue;
+
+            auto payload2 = payloads2.find(root1->name);
+            if (payload2 != payloads2.end())
+            {
+                payload2->second = true;
+                section.add_item(Rpc_Payload_Affected, root1->name, root1->name);
+            }
+            else
+            {
+                section.add_item(Rpc_Payload_Affected, root1->name, "");
+            }
+        }
+
+        for (auto * root2 : roots2)
+        {
+            if (root2->rpc_payload and !payloads2.at(root2->name))
+                section.add_item(Rpc_Payload_Affected, "", root2->name);
+        }
+    }
+}
+
+void Comparison::compare(Source & source1, Source & source2, const vector<string> & selectors)
+{
+    for (auto & selector : selectors)
+    {
+        if (stopped)
+            break;
+
+        if (selector == ".")
+        {
+            compare(source1, source2);
+        }
+        else if (TypeIndex::is_pattern(selector))
+        {
+            compare_matching(source1, source2, selector);
+        }
+        else
+        {
+            compare(source1, selector, source2, counterpart_name(selector));
+        }
+    }
+}
+
+// Compares the types matching a pattern on either side. A type matching on
+// one side only, without a counterpart on the other, is removed or added.
+void Comparison::compare_matching(Source & source1, Source & source2, const string & pattern)
+{
+    auto names1 = source1.type_index().match(pattern);
+    auto names2 = source2.type_index().match(pattern);
+
+    if (names1.empty() and names2.empty())
+    {
+        root.add_item(Name_Missing, pattern, "");
+        check_stop(root);
+        return;
+    }
+
+    auto * pool1 = source1.pool();
+    auto * pool2 = source2.pool();
+    unordered_set<string> matched2;
+
+    for (auto & name1 : names1)
+    {
+        if (stopped)
+            return;
+
+        string name2 = counterpart_name(name1);
+        if (pool2->FindMessageTypeByName(name2) or pool2->FindEnumTypeByName(name2))
+        {
+            matched2.insert(name2);
+            compare(source1, name1, source2, name2);
+        }
+        else
+        {
+            root.add_item(pool1->FindMessageTypeByName(name1) ? File_Message_Removed : File_Enum_Removed, name1, "");
+            check_stop(root);
+        }
+    }
+
+    for (auto & name2 : names2)
+    {
+        if (stopped)
+            return;
+
+        if (matched2.count(name2))
+            continue;
+
+        root.add_item(pool2->FindMessageTypeByName(name2) ? File_Message_Added : File_Enum_Added, "", name2);
+        check_stop(root);
+    }
+}
+
+void Comparison::run(Source & source1, Source & source2, const vector<string> & selectors)
+{
+    compare(source1, source2, selectors);
+
+    if (options.impact)
+        report_impact(source1, source2);
+
+    root.trim();
+}
+
+string Comparison::counterpart_name(const string & name1) const
+{
+    string name2;
+    if (options.type_mapping and options.type_mapping->map(name1, name2))
+        return name2;
+    return name1;
+}
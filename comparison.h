@@ -1,9 +1,21 @@
+#pragma once
+
+#include "change_set.h"
+#include "diagnostics.h"
+#include "impact.h"
+#include "memory_source_tree.h"
+#include "source_tree.h"
+#include "type_index.h"
+#include "type_mapping.h"
+
 #include <google/protobuf/compiler/importer.h>
 #include <google/protobuf/descriptor.h>
 
 #include <iostream>
 #include <sstream>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <list>
 #include <unordered_map>
 
@@ -16,56 +28,132 @@ using google::protobuf::Descriptor;
 using google::protobuf::FieldDescriptor;
 using google::protobuf::EnumDescriptor;
 
-class ErrorCollector : public google::protobuf::compiler::MultiFileErrorCollector
-{
-public:
-    ErrorCollector() {}
-
-    void AddError(const std::string & filename, int line, int column, const std::string & message) override
-    {
-        using namespace std;
-        cerr << "Error: " << filename << "@" << line << "," << column << ": " << message << endl;
-    }
-
-    void AddWarning(const std::string & filename, int line, int column, const std::string & message) override
-    {
-        using namespace std;
-        cerr << "Warning: " << filename << "@" << line << "," << column << ": " << message << endl;
-    }
-};
-
 class Source
 {
-    using DiskSourceTree = google::protobuf::compiler::DiskSourceTree;
+    using SourceTree = google::protobuf::compiler::SourceTree;
     using Importer = google::protobuf::compiler::Importer;
     using DescriptorPool = google::protobuf::DescriptorPool;
+    using DescriptorDatabase = google::protobuf::DescriptorDatabase;
     using FileDescriptor = google::protobuf::FileDescriptor;
 
 public:
     Source() {}
-    Source(const string & file_path, const string & root_dir)
+    // See open_source_tree() for the supported kinds of root_dir.
+    Source(const string & file_path, const string & root_dir):
+        Source(file_path, open_source_tree(root_dir))
+    {}
+
+    // Imports are searched in the roots in order, like protoc -I paths.
+    Source(const string & file_path, const vector<string> & roots):
+        Source(file_path, open_source_tree(roots))
+    {}
+
+    // Throws SourceError if the file or its imports fail to load.
+    // Parsing of a file stops early once its errors are being dropped.
+    Source(const string & file_path, shared_ptr<SourceTree> tree):
+        Source(tree)
     {
-        source_tree.MapPath("", root_dir);
+        load(file_path);
+    }
 
-        ErrorCollector error_collector;
+    // Sets up loading from the tree without loading a file yet,
+    // for Sources created with Source(file_path, other).
+    explicit Source(shared_ptr<SourceTree> tree):
+        source_tree(std::make_shared<StoppableSourceTree>(tree, [errors = error_collector](const string & filename)
+        {
+            return errors->should_stop(filename);
+        }))
+    {
+        importer = std::make_shared<Importer>(source_tree.get(), error_collector.get());
+    }
 
-        importer = std::make_shared<Importer>(&source_tree, &error_collector);
+    // Another file from the source tree of other, sharing the files other
+    // has already loaded and collecting diagnostics together with it.
+    // Must not run concurrently with other loads from the same tree.
+    // Throws SourceError on failure.
+    Source(const string & file_path, const Source & other):
+        error_collector(other.error_collector),
+        source_tree(other.source_tree),
+        importer(other.importer)
+    {
+        load(file_path);
+    }
 
-        d_file_descriptor = importer->Import(file_path);
+    // Files given as path -> content, with no file system access.
+    Source(const string & file_path, std::map<string, string> files):
+        Source(file_path, std::make_shared<MemorySourceTree>(std::move(files)))
+    {}
+
+    // Files provided on demand, see MemorySourceTree.
+    Source(const string & file_path, MemorySourceTree::Provider provider):
+        Source(file_path, std::make_shared<MemorySourceTree>(std::move(provider)))
+    {}
+
+    // Loads the file and its imports from a database instead of parsing
+    // a source tree directly. Throws SourceError on failure.
+    Source(const string & file_path, shared_ptr<DescriptorDatabase> database):
+        database(database),
+        database_pool(std::make_shared<DescriptorPool>(database.get(), error_collector->pool_errors()))
+    {
+        d_file_descriptor = database_pool->FindFileByName(file_path);
         if (!d_file_descriptor)
         {
-            throw std::runtime_error("Failed to load source.");
+            throw SourceError(error_collector->diagnostics());
         }
     }
 
     const FileDescriptor * file_descriptor() const { return d_file_descriptor; }
-    const DescriptorPool * pool() const { return importer->pool(); }
+    // Warnings from loading, if any.
+    const Diagnostics & diagnostics() const { return error_collector->diagnostics(); }
+    const DescriptorPool * pool() const { return importer ? importer->pool() : database_pool.get(); }
+
+    // Indexes are built on first use.
+    // Safe to call from threads sharing the Source.
+
+    const ImpactIndex & impact_index()
+    {
+        std::lock_guard<std::mutex> lock(d_index_mutex);
+        if (!d_impact_index)
+            d_impact_index = std::make_shared<ImpactIndex>(d_file_descriptor);
+        return *d_impact_index;
+    }
+
+    const TypeIndex & type_index()
+    {
+        std::lock_guard<std::mutex> lock(d_index_mutex);
+        if (!d_type_index)
+            d_type_index = std::make_shared<TypeIndex>(d_file_descriptor);
+        return *d_type_index;
+    }
 
 private:
-    DiskSourceTree source_tree;
-    ErrorCollector error_collector;
+    void load(const string & file_path)
+    {
+        auto & diagnostics = error_collector->diagnostics();
+        size_t first = diagnostics.items.size();
+        size_t dropped = diagnostics.dropped;
+
+        d_file_descriptor = importer->Import(file_path);
+        if (!d_file_descriptor)
+        {
+            // Only what this load added, when the collector is shared.
+            Diagnostics added;
+            added.items.assign(std::next(diagnostics.items.begin(), first), diagnostics.items.end());
+            added.dropped = diagnostics.dropped - dropped;
+            throw SourceError(added);
+        }
+    }
+
+    // Declared before source_tree, which refers to it.
+    shared_ptr<ErrorCollector> error_collector = std::make_shared<ErrorCollector>();
+    shared_ptr<SourceTree> source_tree;
     shared_ptr<Importer> importer;
+    shared_ptr<DescriptorDatabase> database;
+    shared_ptr<DescriptorPool> database_pool;
     const FileDescriptor * d_file_descriptor = nullptr;
+    shared_ptr<ImpactIndex> d_impact_index;
+    shared_ptr<TypeIndex> d_type_index;
+    std::mutex d_index_mutex;
 };
 
 class Comparison
@@ -88,7 +176,12 @@ public:
         File_Message_Removed,
         File_Enum_Added,
         File_Enum_Removed,
-        Name_Missing
+        File_Message_Moved,
+        File_Enum_Moved,
+        Rpc_Payload_Affected,
+        Name_Missing,
+        File_Added,
+        File_Removed
     };
 
     struct Item
@@ -107,7 +200,8 @@ public:
         Message_Comparison,
         Message_Field_Comparison,
         Enum_Comparison,
-        Enum_Value_Comparison
+        Enum_Value_Comparison,
+        File_Comparison
     };
 
     struct Section
@@ -136,6 +230,27 @@ public:
 
         bool is_empty() const { return subsections.empty() and items.empty(); }
 
+        bool has_changes() const
+        {
+            if (!items.empty())
+                return true;
+            for (auto & subsection : subsections)
+            {
+                if (subsection.has_changes())
+                    return true;
+            }
+            return false;
+        }
+
+        // Number of items in the section and all its subsections.
+        size_t item_count() const
+        {
+            size_t count = items.size();
+            for (auto & subsection : subsections)
+                count += subsection.item_count();
+            return count;
+        }
+
         void trim()
         {
             auto s = subsections.begin();
@@ -152,27 +267,98 @@ public:
         string message() const;
 
         void print(int level = 0);
+        void print(std::ostream & out, int level = 0);
     };
 
     struct Options
     {
         Options() {}
         bool binary = false;
+        bool impact = false;
+        // Pair removed and added fields with the same type and similar
+        // names as renamed fields.
+        bool detect_renames = false;
+        double rename_similarity = 0.3;
+        // In whole-file comparison, pair removed types with types that were
+        // moved to another package or imported file, or renamed.
+        bool detect_moves = false;
+        double move_similarity = 0.5;
+        // Pairs types across the two sides by full name.
+        shared_ptr<const TypeMapping> type_mapping;
+        // Stop comparing as soon as any difference is found.
+        // The result then only tells whether there are differences.
+        bool stop_at_first_difference = false;
+        // Compare whole files only if they or their imports, directly
+        // or indirectly, are changed.
+        shared_ptr<const ChangeSet> changed_files;
     };
 
     Comparison(const Options & options = Options{});
 
     void compare(Source & source1, Source & source2);
     void compare(Source & source1, const string & name1, Source & source2, const string &name2);
+    // Compares the types selected by each selector, sharing one memo:
+    // "." selects all types in the files, a glob pattern (see TypeIndex)
+    // selects matching types in either source, anything else names a type.
+    void compare(Source & source1, Source & source2, const vector<string> & selectors);
+    void compare_matching(Source & source1, Source & source2, const string & pattern);
+    // Compares the selected types, lists the impact if enabled, and trims the result.
+    void run(Source & source1, Source & source2, const vector<string> & selectors);
+
+    // Name of the type of the second side paired with the given type of the first side.
+    string counterpart_name(const string & name1) const;
     Section * compare(const EnumDescriptor * enum1, const EnumDescriptor * enum2);
     Section * compare(const Descriptor * desc1, const Descriptor * desc2);
-    Section compare(const FieldDescriptor * field1, const FieldDescriptor * field2);
+    void compare(const FieldDescriptor * field1, const FieldDescriptor * field2, Section & section);
     bool compare_default_value(const FieldDescriptor * field1, const FieldDescriptor * field2);
 
+    // Trims the report and lists the RPC payload types that transitively
+    // contain each changed message or enum.
+    void report_impact(Source & source1, Source & source2);
+
     Section root { Root_Section, "", "" };
 
     unordered_map<string, Section*> compared;
 
 private:
+    // Compared pairs of types form a graph through the types of matching
+    // fields. The comparison walks this graph depth-first and runs Tarjan's
+    // algorithm along the way, so that each strongly connected component
+    // (a group of mutually recursive pairs) is decided as one unit: if any
+    // pair in it has changes, all of them have.
+
+    // A field whose type refers to a pair in the current component.
+    // The type change is reported once the component is complete.
+    struct Dependency
+    {
+        Section * section;
+        size_t position;
+        string a;
+        string b;
+    };
+
+    struct Node
+    {
+        int index = 0;
+        int lowlink = 0;
+        bool on_stack = false;
+        bool changed = false;
+        Section * section = nullptr;
+        list<Dependency> dependencies;
+    };
+
+    Node & enter(const string & key, Section * section);
+    void leave(Node & node);
+    void depend_on(const string & key, Section & section, const string & a, const string & b);
+
+    // Notes a difference in section, when stopping at the first one.
+    void check_stop(const Section & section);
+
     Options options;
+    bool stopped = false;
+
+    unordered_map<string, Node> nodes;
+    vector<Node*> stack;
+    Node * current = nullptr;
+    int next_index = 0;
 };
@@ -0,0 +1,543 @@
+#include "daemon.h"
+#include "digest.h"
+#include "mapped_source_tree.h"
+#include "thread_pool.h"
+#include "json/json.hpp"
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <future>
+#include <iostream>
+#include <set>
+
+using nlohmann::json;
+using namespace std;
+
+using google::protobuf::FileDescriptor;
+
+namespace fs = std::filesystem;
+
+namespace {
+
+using FileStamp = DaemonServer::FileStamp;
+
+bool stamp(const string & path, FileStamp & result)
+{
+    struct stat status;
+    if (stat(path.c_str(), &status) != 0)
+        return false;
+
+    result.path = path;
+    result.modified = status.st_mtim.tv_sec * 1000000000LL + status.st_mtim.tv_nsec;
+    result.size = status.st_size;
+    return true;
+}
+
+// Stamps of the files of a source, and of its imports, which are found in
+// directory roots. Files from archives and git revisions do not change.
+vector<FileStamp> stamp_files(const vector<string> & roots, const FileDescriptor * file)
+{
+    vector<FileStamp> stamps;
+    set<const FileDescriptor*> seen;
+    vector<const FileDescriptor*> pending { file };
+
+    while (!pending.empty())
+    {
+        auto * current = pending.back();
+        pending.pop_back();
+
+        if (!seen.insert(current).second)
+            continue;
+
+        for (auto & root : roots)
+        {
+            FileStamp file_stamp;
+            if (fs::is_directory(root) and stamp(root + "/" + current->name(), file_stamp))
+            {
+                stamps.push_back(file_stamp);
+                break;
+            }
+        }
+
+        for (int i = 0; i < current->dependency_count(); ++i)
+            pending.push_back(current->dependency(i));
+    }
+
+    return stamps;
+}
+
+bool unchanged(const vector<FileStamp> & stamps)
+{
+    for (auto & file_stamp : stamps)
+    {
+        FileStamp now;
+        if (!stamp(file_stamp.path, now) or now.modified != file_stamp.modified or now.size != file_stamp.size)
+            return false;
+    }
+
+    return true;
+}
+
+vector<string> selector_list(const json & type)
+{
+    if (type.is_array())
+        return type.get<vector<string>>();
+    return { type.get<string>() };
+}
+
+}
+
+DaemonServer::DaemonServer(const Comparison::Options & options, size_t cache_size):
+    options(options),
+    sources(cache_size),
+    digests(cache_size * 16)
+{}
+
+string DaemonServer::handle(const string & line, chrono::steady_clock::time_point received)
+{
+    json response;
+    string summary = "invalid request";
+
+    try
+    {
+        auto request = json::parse(line);
+
+        if (request.is_object() and request.value("command", "") == "stats")
+        {
+            summary = "stats";
+            response = stats();
+        }
+        else
+        {
+            summary = request.at("file1").get<string>() + " -> " + request.at("file2").get<string>();
+            response = compare(request);
+        }
+    }
+    catch (json::exception & e)
+    {
+        response = { { "error", string("Invalid request: ") + e.what() } };
+    }
+    catch (std::exception & e)
+    {
+        response = { { "error", e.what() } };
+    }
+
+    double latency = chrono::duration<double, milli>(chrono::steady_clock::now() - received).count();
+    response["latency_ms"] = latency;
+
+    {
+        lock_guard<std::mutex> lock(mutex);
+
+        ++requests;
+        if (response.count("error"))
+            ++errors;
+        total_latency += latency;
+        max_latency = std::max(max_latency, latency);
+
+        cerr << summary << ": " << latency << " ms" << (response.count("error") ? " (error)" : "") << endl;
+    }
+
+    return response.dump();
+}
+
+json DaemonServer::compare(const json & request)
+{
+    vector<string> roots1 { request.at("dir1").get<string>() };
+    vector<string> roots2 { request.at("dir2").get<string>() };
+    string file1 = request.at("file1").get<string>();
+    string file2 = request.at("file2").get<string>();
+
+    if (request.count("include1"))
+    {
+        for (auto & root : request["include1"].get<vector<string>>())
+            roots1.push_back(root);
+    }
+    if (request.count("include2"))
+    {
+        for (auto & root : request["include2"].get<vector<string>>())
+            roots2.push_back(root);
+    }
+
+    vector<string> selectors { "." };
+    if (request.count("type"))
+        selectors = selector_list(request["type"]);
+
+    Comparison::Options request_options = options;
+    request_options.binary = request.value("binary", options.binary);
+    request_options.impact = request.value("impact", options.impact);
+    request_options.detect_renames = request.value("renames", options.detect_renames);
+    request_options.detect_moves = request.value("moves", options.detect_moves);
+    if (request.count("map"))
+        request_options.type_mapping = make_shared<TypeMapping>(TypeMapping::load(request["map"].get<string>()));
+
+    auto source1 = source(roots1, file1);
+    auto source2 = source(roots2, file2);
+
+    // Equal digests mean no differences, except when types are paired
+    // by a mapping rather than by name.
+    if (!request_options.type_mapping and digest(source1, selectors) == digest(source2, selectors))
+    {
+        Comparison::Section root { Comparison::Root_Section, "", "" };
+        ostringstream report;
+        root.print(report);
+        return { { "report", report.str() }, { "differences", 0 } };
+    }
+
+    Comparison comparison(request_options);
+    comparison.run(*source1, *source2, selectors);
+
+    ostringstream report;
+    comparison.root.print(report);
+    return { { "report", report.str() }, { "differences", comparison.root.item_count() } };
+}
+
+// Loads a Source or takes it from the cache, reloading it if its
+// files changed. Throws the loading error.
+shared_ptr<Source> DaemonServer::source(const vector<string> & roots, const string & file)
+{
+    SourceKey key(roots, file);
+
+    while (true)
+    {
+        shared_ptr<CachedSource> cached;
+        promise<shared_ptr<Source>> loading;
+        bool load = false;
+
+        {
+            lock_guard<std::mutex> lock(mutex);
+
+            auto found = sources.find(key);
+            if (found)
+            {
+                cached = *found;
+            }
+            else
+            {
+                cached = make_shared<CachedSource>();
+                cached->source = loading.get_future().share();
+                sources.insert(key, cached);
+                load = true;
+                ++source_misses;
+            }
+        }
+
+        if (load)
+        {
+            try
+            {
+                auto loaded = make_shared<Source>(file, roots);
+                cached->stamps = stamp_files(roots, loaded->file_descriptor());
+                loading.set_value(loaded);
+            }
+            catch (...)
+            {
+                // Failures are not cached; the files may be fixed.
+                forget(key, cached);
+                loading.set_exception(current_exception());
+            }
+
+            return cached->source.get();
+        }
+
+        auto loaded = cached->source.get();
+
+        if (unchanged(cached->stamps))
+        {
+            lock_guard<std::mutex> lock(mutex);
+            ++source_hits;
+            return loaded;
+        }
+
+        forget(key, cached);
+    }
+}
+
+// Removes a source from the cache, unless it was replaced already.
+void DaemonServer::forget(const SourceKey & key, const shared_ptr<CachedSource> & cached)
+{
+    lock_guard<std::mutex> lock(mutex);
+
+    auto found = sources.find(key);
+    if (found and *found == cached)
+        sources.erase(key);
+}
+
+uint64_t DaemonServer::digest(const shared_ptr<Source> & source, const vector<string> & selectors)
+{
+    DigestKey key(source.get(), selectors);
+
+    {
+        lock_guard<std::mutex> lock(mutex);
+
+        // The address may have been reused by another Source.
+        auto found = digests.find(key);
+        if (found and found->first.lock() == source)
+        {
+            ++digest_hits;
+            return found->second;
+        }
+        ++digest_misses;
+    }
+
+    uint64_t value = StructuralDigest().digest(*source, selectors);
+
+    lock_guard<std::mutex> lock(mutex);
+    digests.insert(key, { source, value });
+    return value;
+}
+
+json DaemonServer::stats()
+{
+    lock_guard<std::mutex> lock(mutex);
+
+    return {
+        { "requests", requests },
+        { "errors", errors },
+        { "sources", { { "cached", sources.size() }, { "hits", source_hits }, { "misses", source_misses } } },
+        { "digests", { { "cached", digests.size() }, { "hits", digest_hits }, { "misses", digest_misses } } },
+        { "latency", { { "mean_ms", requests ? total_latency / requests : 0.0 }, { "max_ms", max_latency } } }
+    };
+}
+
+namespace {
+
+bool send_all(int connection, const string & data)
+{
+    size_t sent = 0;
+    while (sent < data.size())
+    {
+        ssize_t length = send(connection, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (length < 0 and errno == EINTR)
+            continue;
+        if (length <= 0)
+            return false;
+        sent += length;
+    }
+    return true;
+}
+
+// Longest request line accepted; a longer one closes the connection.
+const size_t max_request_size = 1 << 20;
+
+// A client connection. Requests are answered concurrently, and the
+// answers are sent in the order of the requests. The socket is closed
+// once the connection is neither read nor waiting for answers.
+
+class Connection
+{
+public:
+    struct Answer
+    {
+        bool ready = false;
+        string text;
+    };
+
+    Connection(int fd):
+        fd(fd)
+    {}
+
+    ~Connection()
+    {
+        close(fd);
+    }
+
+    Connection(const Connection &) = delete;
+    Connection & operator=(const Connection &) = delete;
+
+    // Reserves the place of the answer to the next request.
+    shared_ptr<Answer> expect()
+    {
+        lock_guard<std::mutex> lock(mutex);
+        answers.push_back(make_shared<Answer>());
+        return answers.back();
+    }
+
+    // Sends the answer, and any answers to later requests which were
+    // waiting for it.
+    void answer(const shared_ptr<Answer> & answer, const string & text)
+    {
+        lock_guard<std::mutex> lock(mutex);
+
+        answer->text = text;
+        answer->ready = true;
+
+        while (!answers.empty() and answers.front()->ready)
+        {
+            if (!failed and !send_all(fd, answers.front()->text + "\n"))
+                failed = true;
+            answers.pop_front();
+        }
+    }
+
+    const int fd;
+    // Received data not yet split into requests. Only used by the reader.
+    string buffer;
+
+private:
+    std::mutex mutex;
+    deque<shared_ptr<Answer>> answers;
+    bool failed = false;
+};
+
+// Reads requests from all connections and answers each on the pool.
+
+class Dispatcher
+{
+public:
+    Dispatcher(DaemonServer & server, ThreadPool & pool):
+        server(server),
+        pool(pool)
+    {}
+
+    // Returns false once the listening socket fails.
+    bool run(int listener)
+    {
+        while (true)
+        {
+            vector<pollfd> requests { { listener, POLLIN, 0 } };
+            for (auto & connection : connections)
+                requests.push_back({ connection.first, POLLIN, 0 });
+
+            if (poll(requests.data(), requests.size(), -1) < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                cerr << "Failed to wait for requests: " << strerror(errno) << endl;
+                return false;
+            }
+
+            for (size_t i = 1; i < requests.size(); ++i)
+            {
+                if (requests[i].revents)
+                    read(requests[i].fd);
+            }
+
+            if (requests[0].revents & POLLIN)
+            {
+                int fd = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+                if (fd >= 0)
+                {
+                    connections[fd] = make_shared<Connection>(fd);
+                }
+                else if (errno != EINTR and errno != ECONNABORTED and errno != EAGAIN)
+                {
+                    cerr << "Failed to accept connection: " << strerror(errno) << endl;
+                    return false;
+                }
+            }
+        }
+    }
+
+private:
+    void read(int fd)
+    {
+        auto connection = connections[fd];
+
+        char chunk[64 * 1024];
+        ssize_t length = recv(fd, chunk, sizeof(chunk), 0);
+        if (length < 0 and (errno == EINTR or errno == EAGAIN))
+            return;
+
+        auto received = chrono::steady_clock::now();
+        auto & buffer = connection->buffer;
+
+        if (length > 0)
+            buffer.append(chunk, length);
+        else
+            // A last request may lack the line end.
+            buffer += '\n';
+
+        size_t start = 0;
+        size_t end;
+        while ((end = buffer.find('\n', start)) != string::npos)
+        {
+            submit(connection, buffer.substr(start, end - start), received);
+            start = end + 1;
+        }
+        buffer.erase(0, start);
+
+        if (buffer.size() > max_request_size)
+        {
+            connection->answer(connection->expect(), json { { "error", "Request too long." } }.dump());
+            length = 0;
+        }
+
+        // The connection stays open until its answers are sent.
+        if (length <= 0)
+            connections.erase(fd);
+    }
+
+    void submit(const shared_ptr<Connection> & connection, const string & line,
+                chrono::steady_clock::time_point received)
+    {
+        if (line.find_first_not_of(" \t\r") == string::npos)
+            return;
+
+        auto answer = connection->expect();
+        pool.submit([this, connection, answer, line, received]
+        {
+            connection->answer(answer, server.handle(line, received));
+        });
+    }
+
+    DaemonServer & server;
+    ThreadPool & pool;
+    // By socket.
+    map<int, shared_ptr<Connection>> connections;
+};
+
+}
+
+int run_daemon(const string & socket_path, const Comparison::Options & options,
+               unsigned int thread_count, size_t cache_size)
+{
+    sockaddr_un address {};
+    address.sun_family = AF_UNIX;
+
+    if (socket_path.empty() or socket_path.size() >= sizeof(address.sun_path))
+    {
+        cerr << "Invalid socket path: " << socket_path << endl;
+        return 1;
+    }
+    memcpy(address.sun_path, socket_path.c_str(), socket_path.size() + 1);
+
+    // Files may be edited while the daemon holds them.
+    MappedFile::copy_files(true);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener < 0)
+    {
+        cerr << "Failed to create socket: " << strerror(errno) << endl;
+        return 1;
+    }
+
+    unlink(socket_path.c_str());
+
+    if (bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 or
+            listen(listener, SOMAXCONN) != 0)
+    {
+        cerr << "Failed to listen on " << socket_path << ": " << strerror(errno) << endl;
+        close(listener);
+        return 1;
+    }
+
+    cerr << "Listening on " << socket_path << endl;
+
+    DaemonServer server(options, cache_size);
+    ThreadPool pool(thread_count);
+
+    Dispatcher(server, pool).run(listener);
+
+    close(listener);
+    pool.wait();
+    return 1;
+}
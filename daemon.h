@@ -0,0 +1,97 @@
+#pragma once
+
+#include "comparison.h"
+#include "lru_cache.h"
+#include "json/json.hpp"
+
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <vector>
+
+// Answers the requests of run_daemon(), keeping parsed Sources and
+// structural digests in LRU caches. Safe to use from multiple threads.
+
+class DaemonServer
+{
+public:
+    // Modification time and size of a file, to notice changes.
+    struct FileStamp
+    {
+        string path;
+        long long modified = 0;
+        long long size = 0;
+    };
+
+    DaemonServer(const Comparison::Options & options, size_t cache_size);
+
+    // Answers one request line, reporting the latency since received.
+    string handle(const string & line,
+                  std::chrono::steady_clock::time_point received = std::chrono::steady_clock::now());
+
+private:
+    using SourceKey = std::pair<vector<string>, string>;
+    using DigestKey = std::pair<const Source*, vector<string>>;
+
+    struct CachedSource
+    {
+        std::shared_future<shared_ptr<Source>> source;
+        // Set before the source is ready.
+        vector<FileStamp> stamps;
+    };
+
+    nlohmann::json compare(const nlohmann::json & request);
+
+    // Loads a Source or takes it from the cache, reloading it if its
+    // files changed. Throws the loading error.
+    shared_ptr<Source> source(const vector<string> & roots, const string & file);
+
+    // Removes a source from the cache, unless it was replaced already.
+    void forget(const SourceKey & key, const shared_ptr<CachedSource> & cached);
+
+    uint64_t digest(const shared_ptr<Source> & source, const vector<string> & selectors);
+
+    nlohmann::json stats();
+
+    Comparison::Options options;
+
+    std::mutex mutex;
+    LruCache<SourceKey, shared_ptr<CachedSource>> sources;
+    LruCache<DigestKey, std::pair<std::weak_ptr<Source>, uint64_t>> digests;
+
+    size_t requests = 0;
+    size_t errors = 0;
+    size_t source_hits = 0;
+    size_t source_misses = 0;
+    size_t digest_hits = 0;
+    size_t digest_misses = 0;
+    double total_latency = 0;
+    double max_latency = 0;
+};
+
+// Serves comparisons over a Unix domain socket at socket_path, replacing
+// any socket file already there. Clients send one JSON object per line
+// and receive one JSON object per line:
+//
+//     {"dir1": "v1", "file1": "a.proto", "dir2": "v2", "file2": "a.proto",
+//      "type": "corp.Msg", "include1": ["deps"], "binary": true}
+//
+// "type" is a selector or an array of them ("." by default). "include1" and
+// "include2" list more roots as --include1 and --include2 do, and "binary",
+// "impact", "renames", "moves" and "map" override the given options. The
+// answer holds the "report" and the number of "differences", or an
+// "error", and the "latency_ms" of the request since it was received. {"command": "stats"} is
+// answered with counts of requests and cache hits and latency statistics.
+//
+// Parsed Sources and structural digests are kept in LRU caches of
+// cache_size entries (digests: 16 per Source). A cached Source is reloaded
+// if any of its files in a directory root changed on disk. Connections are
+// read by one thread, and each request is answered on a pool of
+// thread_count threads (0 for one per core), so that idle connections
+// hold no thread. Answers on a connection come in the order of its
+// requests. A request line longer than 1 MiB closes the connection. Each
+// request and its latency are logged to standard error.
+//
+// Runs until killed. Returns 1 if the socket can not be set up.
+int run_daemon(const string & socket_path, const Comparison::Options & options,
+               unsigned int thread_count, size_t cache_size);
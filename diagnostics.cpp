@@ -0,0 +1,103 @@
+#include "diagnostics.h"
+#include "json/json.hpp"
+
+#include <sstream>
+
+using namespace std;
+
+static
+string failure_message(const Diagnostics & diagnostics)
+{
+    ostringstream text;
+    diagnostics.print(text);
+    text << "Failed to load source.";
+    return text.str();
+}
+
+bool Diagnostics::has_errors() const
+{
+    for (auto & item : items)
+    {
+        if (item.severity == Diagnostic::Error)
+            return true;
+    }
+    return false;
+}
+
+void Diagnostics::print(ostream & out) const
+{
+    for (auto & item : items)
+    {
+        out << (item.severity == Diagnostic::Error ? "Error: " : "Warning: ")
+            << item.file << "@" << item.line << "," << item.column << ": " << item.message << '\n';
+    }
+
+    if (dropped)
+        out << "(" << dropped << " more diagnostics not shown)" << '\n';
+}
+
+string Diagnostics::json() const
+{
+    auto list = nlohmann::json::array();
+
+    for (auto & item : items)
+    {
+        list.push_back({
+            { "severity", item.severity == Diagnostic::Error ? "error" : "warning" },
+            { "file", item.file },
+            { "line", item.line },
+            { "column", item.column },
+            { "message", item.message }
+        });
+    }
+
+    return nlohmann::json({ { "diagnostics", list }, { "dropped", dropped } }).dump();
+}
+
+void ErrorCollector::add(Diagnostic::Severity severity, const string & filename, int line, int column,
+                         const string & message)
+{
+    auto & counts = file_counts[filename];
+
+    if (severity == Diagnostic::Error)
+        counts.has_errors = true;
+
+    // Past the total limit, nothing more is kept or remembered.
+    if (d_diagnostics.items.size() >= total_limit)
+    {
+        ++counts.dropped;
+        ++d_diagnostics.dropped;
+        return;
+    }
+
+    if (!seen.emplace(filename, line, column, message).second)
+        return;
+
+    if (counts.kept >= per_file_limit)
+    {
+        ++counts.dropped;
+        ++d_diagnostics.dropped;
+        return;
+    }
+
+    ++counts.kept;
+
+    Diagnostic diagnostic;
+    diagnostic.severity = severity;
+    diagnostic.file = filename;
+    diagnostic.line = line;
+    diagnostic.column = column;
+    diagnostic.message = message;
+    d_diagnostics.items.push_back(std::move(diagnostic));
+}
+
+bool ErrorCollector::should_stop(const string & filename) const
+{
+    auto counts = file_counts.find(filename);
+    return counts != file_counts.end() and counts->second.has_errors and counts->second.dropped;
+}
+
+SourceError::SourceError(const Diagnostics & diagnostics):
+    std::runtime_error(failure_message(diagnostics)),
+    d_diagnostics(diagnostics)
+{}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <google/protobuf/compiler/importer.h>
+#include <google/protobuf/descriptor.h>
+
+#include <map>
+#include <ostream>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+struct Diagnostic
+{
+    enum Severity { Error, Warning };
+
+    Severity severity = Error;
+    std::string file;
+    // As reported by the parser: zero-based, or -1 for the file as a whole.
+    int line = -1;
+    int column = 0;
+    std::string message;
+};
+
+struct Diagnostics
+{
+    std::vector<Diagnostic> items;
+    // Diagnostics over the limits, counted but not kept.
+    size_t dropped = 0;
+
+    bool has_errors() const;
+
+    // One line per diagnostic.
+    void print(std::ostream & out) const;
+    // {"diagnostics": [{"severity", "file", "line", "column", "message"}, ...], "dropped": n}
+    std::string json() const;
+};
+
+// Collects diagnostics from parsing and importing .proto files.
+// Repeated diagnostics are kept once. At most per_file_limit diagnostics
+// per file and total_limit in all are kept; the rest are only counted.
+
+class ErrorCollector : public google::protobuf::compiler::MultiFileErrorCollector
+{
+public:
+    ErrorCollector(size_t per_file_limit = 20, size_t total_limit = 100):
+        per_file_limit(per_file_limit),
+        total_limit(total_limit)
+    {}
+
+    void AddError(const std::string & filename, int line, int column, const std::string & message) override
+    {
+        add(Diagnostic::Error, filename, line, column, message);
+    }
+
+    void AddWarning(const std::string & filename, int line, int column, const std::string & message) override
+    {
+        add(Diagnostic::Warning, filename, line, column, message);
+    }
+
+    const Diagnostics & diagnostics() const { return d_diagnostics; }
+
+    // Whether the file has errors, so loading it will fail, and its
+    // diagnostics are already being dropped. Nothing is gained by reading
+    // further.
+    bool should_stop(const std::string & filename) const;
+
+    // Collects errors from building descriptors into this collector.
+    google::protobuf::DescriptorPool::ErrorCollector * pool_errors() { return &d_pool_errors; }
+
+private:
+    class PoolErrors : public google::protobuf::DescriptorPool::ErrorCollector
+    {
+    public:
+        PoolErrors(::ErrorCollector * owner): owner(owner) {}
+
+        void AddError(const std::string & filename, const std::string & element_name,
+                      const google::protobuf::Message *, ErrorLocation, const std::string & message) override
+        {
+            owner->add(Diagnostic::Error, filename, -1, 0, element_name + ": " + message);
+        }
+
+        void AddWarning(const std::string & filename, const std::string & element_name,
+                        const google::protobuf::Message *, ErrorLocation, const std::string & message) override
+        {
+            owner->add(Diagnostic::Warning, filename, -1, 0, element_name + ": " + message);
+        }
+
+    private:
+        ::ErrorCollector * owner;
+    };
+
+    void add(Diagnostic::Severity severity, const std::string & filename, int line, int column,
+             const std::string & message);
+
+    size_t per_file_limit;
+    size_t total_limit;
+    struct FileCounts
+    {
+        size_t kept = 0;
+        size_t dropped = 0;
+        bool has_errors = false;
+    };
+
+    Diagnostics d_diagnostics;
+    std::set<std::tuple<std::string, int, int, std::string>> seen;
+    std::map<std::string, FileCounts> file_counts;
+    PoolErrors d_pool_errors { this };
+};
+
+// A Source failed to load. what() includes the diagnostics.
+
+class SourceError : public std::runtime_error
+{
+public:
+    SourceError(const Diagnostics & diagnostics);
+
+    const Diagnostics & diagnostics() const { return d_diagnostics; }
+
+private:
+    Diagnostics d_diagnostics;
+};
@@ -0,0 +1,195 @@
+#include "digest.h"
+#include "comparison.h"
+
+#include <climits>
+
+using namespace std;
+
+using google::protobuf::Descriptor;
+using google::protobuf::EnumDescriptor;
+using google::protobuf::FieldDescriptor;
+
+static
+uint64_t mix(uint64_t x)
+{
+    // splitmix64 finalizer
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return x;
+}
+
+static
+uint64_t combine(uint64_t hash, uint64_t value)
+{
+    return mix(hash ^ (value + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2)));
+}
+
+static
+uint64_t combine(uint64_t hash, const string & value)
+{
+    uint64_t h = 14695981039346656037ull;
+    for (unsigned char c : value)
+    {
+        h ^= c;
+        h *= 1099511628211ull;
+    }
+    return combine(hash, h);
+}
+
+static
+uint64_t default_value_digest(const FieldDescriptor * field)
+{
+    if (!field->has_default_value())
+        return 0;
+
+    switch(field->cpp_type())
+    {
+    case FieldDescriptor::CPPTYPE_INT32:
+        return combine(1, uint64_t(field->default_value_int32()));
+    case FieldDescriptor::CPPTYPE_INT64:
+        return combine(1, uint64_t(field->default_value_int64()));
+    case FieldDescriptor::CPPTYPE_UINT32:
+        return combine(1, uint64_t(field->default_value_uint32()));
+    case FieldDescriptor::CPPTYPE_UINT64:
+        return combine(1, uint64_t(field->default_value_uint64()));
+    case FieldDescriptor::CPPTYPE_FLOAT:
+        return combine(1, std::to_string(field->default_value_float()));
+    case FieldDescriptor::CPPTYPE_DOUBLE:
+        return combine(1, std::to_string(field->default_value_double()));
+    case FieldDescriptor::CPPTYPE_BOOL:
+        return combine(1, uint64_t(field->default_value_bool()));
+    case FieldDescriptor::CPPTYPE_STRING:
+        return combine(1, field->default_value_string());
+    case FieldDescriptor::CPPTYPE_ENUM:
+        return combine(1, uint64_t(field->default_value_enum()->number()));
+    default:
+        return 1;
+    }
+}
+
+uint64_t StructuralDigest::digest(const EnumDescriptor * desc)
+{
+    auto cached = enums.find(desc);
+    if (cached != enums.end())
+        return cached->second;
+
+    uint64_t hash = combine(0, uint64_t(desc->value_count()));
+    for (int i = 0; i < desc->value_count(); ++i)
+    {
+        auto * value = desc->value(i);
+        hash = combine(hash, value->name());
+        hash = combine(hash, uint64_t(value->number()));
+    }
+
+    enums.emplace(desc, hash);
+    return hash;
+}
+
+uint64_t StructuralDigest::digest(const Descriptor * desc)
+{
+    int min_reference = INT_MAX;
+    return message_digest(desc, min_reference);
+}
+
+uint64_t StructuralDigest::message_digest(const Descriptor * desc, int & min_reference)
+{
+    auto cached = messages.find(desc);
+    if (cached != messages.end())
+        return cached->second;
+
+    int depth = int(path.size());
+
+    auto on_path = path.find(desc);
+    if (on_path != path.end())
+    {
+        min_reference = min(min_reference, on_path->second);
+        return combine(2, uint64_t(depth - on_path->second));
+    }
+
+    path.emplace(desc, depth);
+
+    int min_nested_reference = INT_MAX;
+
+    uint64_t hash = combine(3, uint64_t(desc->field_count()));
+    for (int i = 0; i < desc->field_count(); ++i)
+    {
+        auto * field = desc->field(i);
+        hash = combine(hash, field->name());
+        hash = combine(hash, uint64_t(field->number()));
+        hash = combine(hash, uint64_t(field->label()));
+        hash = combine(hash, uint64_t(field->type()));
+        hash = combine(hash, default_value_digest(field));
+
+        if (field->type() == FieldDescriptor::TYPE_ENUM)
+            hash = combine(hash, digest(field->enum_type()));
+        else if (field->type() == FieldDescriptor::TYPE_MESSAGE)
+            hash = combine(hash, message_digest(field->message_type(), min_nested_reference));
+    }
+
+    path.erase(desc);
+
+    // Types referring to types further up the path are hashed relative to
+    // this particular path, so they are not cached.
+    if (min_nested_reference >= depth)
+        messages.emplace(desc, hash);
+
+    min_reference = min(min_reference, min_nested_reference);
+
+    return hash;
+}
+
+uint64_t StructuralDigest::named_digest(Source & source, const string & name)
+{
+    uint64_t hash = combine(4, name);
+
+    if (auto * desc = source.pool()->FindMessageTypeByName(name))
+        return combine(hash, digest(desc));
+
+    if (auto * desc = source.pool()->FindEnumTypeByName(name))
+        return combine(hash, digest(desc));
+
+    return hash;
+}
+
+uint64_t StructuralDigest::digest(Source & source, const vector<string> & selectors)
+{
+    uint64_t hash = 0;
+
+    for (auto & selector : selectors)
+    {
+        if (selector == ".")
+        {
+            auto * file = source.file_descriptor();
+
+            hash = combine(hash, uint64_t(file->message_type_count()));
+            for (int i = 0; i < file->message_type_count(); ++i)
+            {
+                hash = combine(hash, file->message_type(i)->name());
+                hash = combine(hash, digest(file->message_type(i)));
+            }
+
+            hash = combine(hash, uint64_t(file->enum_type_count()));
+            for (int i = 0; i < file->enum_type_count(); ++i)
+            {
+                hash = combine(hash, file->enum_type(i)->name());
+                hash = combine(hash, digest(file->enum_type(i)));
+            }
+        }
+        else if (TypeIndex::is_pattern(selector))
+        {
+            auto names = source.type_index().match(selector);
+            hash = combine(hash, uint64_t(names.size()));
+            for (auto & name : names)
+                hash = combine(hash, named_digest(source, name));
+        }
+        else
+        {
+            hash = combine(hash, named_digest(source, selector));
+        }
+    }
+
+    return hash;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <google/protobuf/descriptor.h>
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using std::string;
+using std::unordered_map;
+using std::vector;
+
+class Source;
+
+// 64-bit digests of the structure of types: everything a Comparison looks
+// at in a type and, recursively, in the types of its fields. If two types
+// (or selections of types) have equal digests, comparing them reports no
+// differences, so the comparison can be skipped.
+//
+// Recursive references are hashed as the distance to the referenced type
+// on the traversal path, so equal structures get equal digests regardless
+// of names. Digests of types outside of cycles are cached.
+
+class StructuralDigest
+{
+public:
+    uint64_t digest(const google::protobuf::Descriptor * desc);
+    uint64_t digest(const google::protobuf::EnumDescriptor * desc);
+
+    // Digest of the types selected in the source by the selectors,
+    // as interpreted by Comparison::compare(source1, source2, selectors).
+    uint64_t digest(Source & source, const vector<string> & selectors);
+
+private:
+    uint64_t message_digest(const google::protobuf::Descriptor * desc, int & min_reference);
+    uint64_t named_digest(Source & source, const string & name);
+
+    unordered_map<const google::protobuf::Descriptor*, uint64_t> messages;
+    unordered_map<const google::protobuf::EnumDescriptor*, uint64_t> enums;
+    unordered_map<const google::protobuf::Descriptor*, int> path;
+};
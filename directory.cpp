@@ -0,0 +1,285 @@
+#include "directory.h"
+#include "mapped_source_tree.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <future>
+#include <iostream>
+#include <set>
+#include <stdexcept>
+#include <string_view>
+
+using namespace std;
+
+namespace fs = std::filesystem;
+
+namespace {
+
+struct Side
+{
+    map<string, shared_ptr<Source>> sources;
+    map<string, string> errors;
+};
+
+// Loads all files through one importer.
+Side load_side(const string & dir, const vector<string> & files)
+{
+    Side side;
+    Source importer(open_source_tree(dir));
+
+    for (auto & file : files)
+    {
+        try
+        {
+            side.sources[file] = make_shared<Source>(file, importer);
+        }
+        catch (std::exception & e)
+        {
+            side.errors[file] = e.what();
+        }
+    }
+
+    return side;
+}
+
+// Files imported by a file, found by scanning its text without parsing it.
+// Imports precede all definitions, so the scan stops at the first one.
+// Comments and strings are skipped, so that words in them do not count.
+vector<string> scan_imports(const string & path)
+{
+    vector<string> imports;
+
+    auto file = MappedFile::open(path);
+    if (!file)
+        return imports;
+
+    string_view text(file->data(), file->size());
+    size_t position = 0;
+    // Whether the next word starts a statement, and whether the current
+    // statement is an import.
+    bool statement_start = true;
+    bool in_import = false;
+
+    while (position < text.size())
+    {
+        char c = text[position];
+
+        if (text.substr(position, 2) == "//")
+        {
+            position = text.find('\n', position);
+        }
+        else if (text.substr(position, 2) == "/*")
+        {
+            position = text.find("*/", position + 2);
+            if (position != string_view::npos)
+                position += 2;
+        }
+        else if (c == '"' or c == '\'')
+        {
+            size_t end = position + 1;
+            while (end < text.size() and text[end] != c and text[end] != '\n')
+                end += text[end] == '\\' ? 2 : 1;
+
+            if (in_import)
+                imports.emplace_back(text.substr(position + 1, std::min(end, text.size()) - position - 1));
+
+            in_import = false;
+            statement_start = false;
+            position = end + 1;
+        }
+        else if (isalpha(static_cast<unsigned char>(c)) or c == '_')
+        {
+            size_t end = position;
+            while (end < text.size() and (isalnum(static_cast<unsigned char>(text[end])) or text[end] == '_' or text[end] == '.'))
+                ++end;
+
+            auto word = text.substr(position, end - position);
+            if (statement_start)
+            {
+                if (word == "message" or word == "enum" or word == "service" or word == "extend")
+                    break;
+                in_import = word == "import";
+            }
+
+            statement_start = false;
+            position = end;
+        }
+        else
+        {
+            if (c == ';')
+            {
+                statement_start = true;
+                in_import = false;
+            }
+            ++position;
+        }
+    }
+
+    return imports;
+}
+
+// Files under dir which are changed or import a changed file,
+// directly or indirectly.
+set<string> affected_files(const string & dir, const vector<string> & files, const ChangeSet & changes)
+{
+    map<string, vector<string>> importers;
+    for (auto & file : files)
+    {
+        for (auto & import : scan_imports(dir + "/" + file))
+            importers[import].push_back(file);
+    }
+
+    set<string> affected;
+    vector<string> pending;
+
+    for (auto & file : files)
+    {
+        if (changes.contains(file))
+            pending.push_back(file);
+    }
+
+    while (!pending.empty())
+    {
+        string file = pending.back();
+        pending.pop_back();
+
+        if (!affected.insert(file).second)
+            continue;
+
+        for (auto & importer : importers[file])
+            pending.push_back(importer);
+    }
+
+    return affected;
+}
+
+}
+
+vector<string> find_proto_files(const string & dir)
+{
+    if (!fs::is_directory(dir))
+        throw std::runtime_error("Not a directory: " + dir);
+
+    vector<string> files;
+
+    for (auto & entry : fs::recursive_directory_iterator(dir))
+    {
+        if (entry.is_regular_file() and entry.path().extension() == ".proto")
+            files.push_back(entry.path().lexically_relative(dir).generic_string());
+    }
+
+    sort(files.begin(), files.end());
+
+    return files;
+}
+
+DirectoryComparison compare_directories(const string & dir1, const string & dir2,
+                                        const vector<string> & selectors,
+                                        const Comparison::Options & options,
+                                        unsigned int thread_count)
+{
+    auto files1 = find_proto_files(dir1);
+    auto files2 = find_proto_files(dir2);
+
+    DirectoryComparison result;
+
+    vector<string> paired;
+    set_intersection(files1.begin(), files1.end(), files2.begin(), files2.end(), back_inserter(paired));
+
+    vector<string> removed;
+    set_difference(files1.begin(), files1.end(), files2.begin(), files2.end(), back_inserter(removed));
+
+    vector<string> added;
+    set_difference(files2.begin(), files2.end(), files1.begin(), files1.end(), back_inserter(added));
+
+    for (auto & file : removed)
+        result.root.add_item(Comparison::File_Removed, file, "");
+    for (auto & file : added)
+        result.root.add_item(Comparison::File_Added, "", file);
+
+    if (options.changed_files)
+    {
+        auto affected1 = affected_files(dir1, files1, *options.changed_files);
+        auto affected2 = affected_files(dir2, files2, *options.changed_files);
+
+        auto unaffected = [&](const string & file)
+        {
+            return !affected1.count(file) and !affected2.count(file);
+        };
+
+        paired.erase(remove_if(paired.begin(), paired.end(), unaffected), paired.end());
+    }
+
+    // Only paired files need to be loaded.
+    auto side1 = async(launch::async, load_side, dir1, paired);
+    auto side2 = load_side(dir2, paired);
+    auto side1_loaded = side1.get();
+
+    for (auto & error : side1_loaded.errors)
+        result.errors.emplace(dir1 + "/" + error.first, error.second);
+    for (auto & error : side2.errors)
+        result.errors.emplace(dir2 + "/" + error.first, error.second);
+
+    vector<Comparison::Section> sections;
+    for (auto & file : paired)
+        sections.emplace_back(Comparison::File_Comparison, file, file);
+
+    {
+        ThreadPool pool(thread_count);
+
+        for (size_t i = 0; i < paired.size(); ++i)
+        {
+            auto source1 = side1_loaded.sources.find(paired[i]);
+            auto source2 = side2.sources.find(paired[i]);
+            if (source1 == side1_loaded.sources.end() or source2 == side2.sources.end())
+                continue;
+
+            pool.submit([&, i, source1, source2]
+            {
+                Comparison comparison(options);
+                comparison.run(*source1->second, *source2->second, selectors);
+
+                auto & section = sections[i];
+                section.items.splice(section.items.end(), comparison.root.items);
+                section.subsections.splice(section.subsections.end(), comparison.root.subsections);
+            });
+        }
+
+        pool.wait();
+    }
+
+    for (auto & section : sections)
+    {
+        if (!section.is_empty())
+            result.root.subsections.push_back(std::move(section));
+    }
+
+    return result;
+}
+
+int run_directories(const string & dir1, const string & dir2,
+                    const vector<string> & selectors,
+                    const Comparison::Options & options,
+                    unsigned int thread_count)
+{
+    DirectoryComparison comparison;
+
+    try
+    {
+        comparison = compare_directories(dir1, dir2, selectors, options, thread_count);
+    }
+    catch (std::exception & e)
+    {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    for (auto & error : comparison.errors)
+        cerr << error.first << ": " << error.second << endl;
+
+    comparison.root.print();
+
+    return comparison.errors.empty() ? 0 : 1;
+}
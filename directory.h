@@ -0,0 +1,45 @@
+#pragma once
+
+#include "comparison.h"
+
+#include <map>
+#include <vector>
+
+// Result of comparing the .proto files under two directories.
+struct DirectoryComparison
+{
+    // Files only under dir1 or dir2 as File_Removed and File_Added items,
+    // and a File_Comparison section with the differences of each pair of
+    // files with the same relative path.
+    Comparison::Section root { Comparison::Root_Section, "", "" };
+
+    // Path (directory and relative path) -> error, for files that failed
+    // to load. Their pairs are not compared.
+    std::map<string, string> errors;
+};
+
+// Relative paths of all .proto files under dir, sorted.
+// Throws std::runtime_error if dir is not a directory.
+vector<string> find_proto_files(const string & dir);
+
+// Compares the .proto files under two directories, paired by relative path.
+//
+// Each side loads all its files through one importer, so imports shared by
+// many files are parsed once per side. The two sides load concurrently, and
+// the pairs of files are then compared on thread_count threads (zero means
+// one per core). With Options::changed_files, pairs which are not affected
+// by the changes, according to a scan of their imports, are neither loaded
+// nor compared.
+//
+// Throws std::runtime_error if either directory can not be listed.
+DirectoryComparison compare_directories(const string & dir1, const string & dir2,
+                                        const vector<string> & selectors,
+                                        const Comparison::Options & options,
+                                        unsigned int thread_count = 0);
+
+// Runs compare_directories() and prints the report.
+// Returns 0 on success, 1 if any file failed to load.
+int run_directories(const string & dir1, const string & dir2,
+                    const vector<string> & selectors,
+                    const Comparison::Options & options,
+                    unsigned int thread_count);
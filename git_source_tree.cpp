@@ -0,0 +1,324 @@
+#include "git_source_tree.h"
+
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+
+using google::protobuf::io::ArrayInputStream;
+using google::protobuf::io::ZeroCopyInputStream;
+
+namespace {
+
+// Input stream over a string that it owns.
+class OwningInputStream : public ZeroCopyInputStream
+{
+public:
+    OwningInputStream(string && content):
+        content(std::move(content)),
+        stream(this->content.data(), int(this->content.size()))
+    {}
+
+    bool Next(const void ** data, int * size) override { return stream.Next(data, size); }
+    void BackUp(int count) override { stream.BackUp(count); }
+    bool Skip(int count) override { return stream.Skip(count); }
+    int64_t ByteCount() const override { return stream.ByteCount(); }
+
+private:
+    string content;
+    ArrayInputStream stream;
+};
+
+}
+
+GitRepository::GitRepository(const string & work_dir):
+    work_dir(work_dir)
+{
+    start(contents, "--batch");
+
+    try
+    {
+        start(checks, "--batch-check");
+    }
+    catch (std::exception &)
+    {
+        stop(contents);
+        throw;
+    }
+}
+
+GitRepository::~GitRepository()
+{
+    stop(contents);
+    stop(checks);
+}
+
+void GitRepository::start(CatFile & process, const char * mode)
+{
+    int to_git[2];
+    int from_git[2];
+
+    if (pipe(to_git) != 0)
+        throw std::runtime_error("Failed to create pipe to git.");
+
+    if (pipe(from_git) != 0)
+    {
+        close(to_git[0]);
+        close(to_git[1]);
+        throw std::runtime_error("Failed to create pipe from git.");
+    }
+
+    process.pid = fork();
+
+    if (process.pid == 0)
+    {
+        dup2(to_git[0], STDIN_FILENO);
+        dup2(from_git[1], STDOUT_FILENO);
+        close(to_git[0]);
+        close(to_git[1]);
+        close(from_git[0]);
+        close(from_git[1]);
+        execlp("git", "git", "-C", work_dir.c_str(), "cat-file", mode, (char*) nullptr);
+        _exit(127);
+    }
+
+    close(to_git[0]);
+    close(from_git[1]);
+
+    if (process.pid < 0)
+    {
+        close(to_git[1]);
+        close(from_git[0]);
+        throw std::runtime_error("Failed to start git.");
+    }
+
+    // Do not leak our ends of the pipes into other child processes.
+    fcntl(to_git[1], F_SETFD, FD_CLOEXEC);
+    fcntl(from_git[0], F_SETFD, FD_CLOEXEC);
+
+    process.requests = fdopen(to_git[1], "w");
+    process.responses = fdopen(from_git[0], "r");
+}
+
+void GitRepository::stop(CatFile & process)
+{
+    // git exits when its input is closed.
+    if (process.requests)
+        fclose(process.requests);
+    if (process.responses)
+        fclose(process.responses);
+    if (process.pid > 0)
+        waitpid(process.pid, nullptr, 0);
+
+    process.requests = nullptr;
+    process.responses = nullptr;
+    process.pid = -1;
+}
+
+shared_ptr<GitRepository> GitRepository::open(const string & work_dir)
+{
+    static std::mutex mutex;
+    static map<string, weak_ptr<GitRepository>> repositories;
+
+    lock_guard<std::mutex> lock(mutex);
+
+    auto & entry = repositories[work_dir];
+    auto repository = entry.lock();
+    if (!repository)
+    {
+        repository = make_shared<GitRepository>(work_dir);
+        entry = repository;
+    }
+
+    return repository;
+}
+
+bool GitRepository::request(CatFile & process, const string & spec, string & id, string & type, size_t & size)
+{
+    if (fputs(spec.c_str(), process.requests) == EOF or fputc('\n', process.requests) == EOF or
+            fflush(process.requests) != 0)
+        throw std::runtime_error("Failed to send request to git.");
+
+    string header;
+    int c;
+    while ((c = fgetc(process.responses)) != EOF and c != '\n')
+        header += char(c);
+
+    if (c == EOF)
+        throw std::runtime_error("Unexpected end of output from git.");
+
+    // "<id> <type> <size>" or "<spec> missing" or "<spec> ambiguous"
+    istringstream fields(header);
+    size = 0;
+    return bool(fields >> id >> type >> size);
+}
+
+bool GitRepository::read(const string & spec, string * content, string * id, string * type)
+{
+    if (spec.find('\n') != string::npos)
+        return false;
+
+    lock_guard<std::mutex> lock(contents.mutex);
+
+    string object_id, object_type;
+    size_t size;
+
+    if (!request(contents, spec, object_id, object_type, size))
+        return false;
+
+    if (id)
+        *id = object_id;
+    if (type)
+        *type = object_type;
+
+    string data(size, '\0');
+    if (size and fread(&data[0], 1, size, contents.responses) != size)
+        throw std::runtime_error("Unexpected end of output from git.");
+
+    // Each object is followed by a newline.
+    fgetc(contents.responses);
+
+    if (content)
+        *content = std::move(data);
+
+    return true;
+}
+
+bool GitRepository::check(const string & spec, string * id, string * type)
+{
+    if (spec.find('\n') != string::npos)
+        return false;
+
+    lock_guard<std::mutex> lock(checks.mutex);
+
+    string object_id, object_type;
+    size_t size;
+
+    if (!request(checks, spec, object_id, object_type, size))
+        return false;
+
+    if (id)
+        *id = object_id;
+    if (type)
+        *type = object_type;
+
+    return true;
+}
+
+string GitRepository::commit_id(const string & revision)
+{
+    string id;
+    if (!check(revision + "^{commit}", &id))
+        throw std::runtime_error("Not a git revision: " + revision);
+    return id;
+}
+
+vector<string> GitRepository::commits(const string & range)
+{
+    int from_git[2];
+    if (pipe(from_git) != 0)
+        throw std::runtime_error("Failed to create pipe from git.");
+
+    pid_t child = fork();
+
+    if (child == 0)
+    {
+        dup2(from_git[1], STDOUT_FILENO);
+        close(from_git[0]);
+        close(from_git[1]);
+        execlp("git", "git", "-C", work_dir.c_str(), "rev-list", "--reverse", "--first-parent",
+               range.c_str(), "--", (char*) nullptr);
+        _exit(127);
+    }
+
+    close(from_git[1]);
+
+    if (child < 0)
+    {
+        close(from_git[0]);
+        throw std::runtime_error("Failed to start git.");
+    }
+
+    vector<string> result;
+    string line;
+    char buffer[4096];
+    ssize_t size;
+
+    while ((size = ::read(from_git[0], buffer, sizeof(buffer))) > 0)
+    {
+        for (ssize_t i = 0; i < size; ++i)
+        {
+            if (buffer[i] == '\n')
+            {
+                result.push_back(line);
+                line.clear();
+            }
+            else
+            {
+                line += buffer[i];
+            }
+        }
+    }
+
+    close(from_git[0]);
+
+    int status = 0;
+    waitpid(child, &status, 0);
+    if (!WIFEXITED(status) or WEXITSTATUS(status) != 0)
+        throw std::runtime_error("git rev-list failed for: " + range);
+
+    return result;
+}
+
+GitSourceTree::GitSourceTree(shared_ptr<GitRepository> repository,
+                             const string & revision, const string & dir):
+    repository(repository),
+    d_commit(repository->commit_id(revision)),
+    dir(dir)
+{
+    while (!this->dir.empty() and this->dir.back() == '/')
+        this->dir.pop_back();
+}
+
+string GitSourceTree::object_spec(const string & filename) const
+{
+    if (dir.empty() or dir == ".")
+        return d_commit + ":" + filename;
+    else
+        return d_commit + ":" + dir + "/" + filename;
+}
+
+ZeroCopyInputStream * GitSourceTree::Open(const string & filename)
+{
+    string content;
+
+    if (!read(filename, &content, nullptr))
+    {
+        last_error = "File not found.";
+        return nullptr;
+    }
+
+    return new OwningInputStream(std::move(content));
+}
+
+string GitSourceTree::blob_id(const string & filename)
+{
+    string id, type;
+    if (!repository->check(object_spec(filename), &id, &type) or type != "blob")
+        return "";
+    return id;
+}
+
+bool GitSourceTree::read(const string & filename, string * content, string * id)
+{
+    string type;
+    return repository->read(object_spec(filename), content, id, &type) and type == "blob";
+}
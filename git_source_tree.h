@@ -0,0 +1,97 @@
+#pragma once
+
+#include <google/protobuf/compiler/importer.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+// A local git repository, read through persistent "git cat-file --batch"
+// and "git cat-file --batch-check" processes, the latter for lookups which
+// do not need the content. Safe to use from multiple threads.
+
+class GitRepository
+{
+public:
+    // Throws std::runtime_error if git can not be started.
+    GitRepository(const std::string & work_dir);
+    ~GitRepository();
+
+    GitRepository(const GitRepository &) = delete;
+    GitRepository & operator=(const GitRepository &) = delete;
+
+    // Shared instance per working directory.
+    static std::shared_ptr<GitRepository> open(const std::string & work_dir);
+
+    // Reads the object named by spec (e.g. "HEAD~1:protos/a.proto").
+    // Returns false if there is no such object.
+    // Throws std::runtime_error if communication with git fails.
+    bool read(const std::string & spec, std::string * content,
+              std::string * id = nullptr, std::string * type = nullptr);
+
+    // Like read(), without transferring the content of the object.
+    bool check(const std::string & spec, std::string * id, std::string * type = nullptr);
+
+    // Full commit id of a revision. Throws std::runtime_error if there is none.
+    std::string commit_id(const std::string & revision);
+
+    // Commits in a revision range (e.g. "v1..v2"), oldest first,
+    // following only the first parent of merges.
+    // Throws std::runtime_error if git fails.
+    std::vector<std::string> commits(const std::string & range);
+
+private:
+    // A "git cat-file" process, answering one request at a time.
+    struct CatFile
+    {
+        std::mutex mutex;
+        pid_t pid = -1;
+        FILE * requests = nullptr;
+        FILE * responses = nullptr;
+    };
+
+    void start(CatFile & process, const char * mode);
+    void stop(CatFile & process);
+    // Sends a request and reads the header of the answer.
+    // Returns false if there is no such object.
+    bool request(CatFile & process, const std::string & spec,
+                 std::string & id, std::string & type, size_t & size);
+
+    std::string work_dir;
+
+    CatFile contents;
+    CatFile checks;
+};
+
+// Files at a revision of a git repository, under an optional directory.
+// The revision is resolved to a commit once, on construction.
+
+class GitSourceTree : public google::protobuf::compiler::SourceTree
+{
+public:
+    GitSourceTree(std::shared_ptr<GitRepository> repository,
+                  const std::string & revision, const std::string & dir = "");
+
+    google::protobuf::io::ZeroCopyInputStream * Open(const std::string & filename) override;
+    std::string GetLastErrorMessage() override { return last_error; }
+
+    const std::string & commit() const { return d_commit; }
+
+    // Blob id of a file, or an empty string if there is no such file.
+    // Does not transfer the content.
+    std::string blob_id(const std::string & filename);
+
+    // Content and blob id of a file. Returns false if there is no such file.
+    bool read(const std::string & filename, std::string * content, std::string * id);
+
+private:
+    std::string object_spec(const std::string & filename) const;
+
+    std::shared_ptr<GitRepository> repository;
+    std::string d_commit;
+    std::string dir;
+    std::string last_error;
+};
@@ -0,0 +1,223 @@
+#include "impact.h"
+
+#include <algorithm>
+
+using namespace std;
+
+using google::protobuf::Descriptor;
+using google::protobuf::FieldDescriptor;
+using google::protobuf::FileDescriptor;
+
+ImpactIndex::ImpactIndex(const FileDescriptor * file)
+{
+    for (int i = 0; i < file->message_type_count(); ++i)
+    {
+        add_root(file->message_type(i), false);
+    }
+
+    for (int i = 0; i < file->service_count(); ++i)
+    {
+        auto * service = file->service(i);
+        for (int j = 0; j < service->method_count(); ++j)
+        {
+            auto * method = service->method(j);
+            add_root(method->input_type(), true);
+            add_root(method->output_type(), true);
+        }
+    }
+
+    condense();
+}
+
+int ImpactIndex::add_type(const string & name, bool * added)
+{
+    auto result = d_type_index.emplace(name, int(d_edges.size()));
+    if (result.second)
+        d_edges.emplace_back();
+    if (added)
+        *added = result.second;
+    return result.first->second;
+}
+
+int ImpactIndex::add_message(const Descriptor * desc)
+{
+    bool added;
+    int id = add_type(desc->full_name(), &added);
+    if (!added)
+        return id;
+
+    vector<const Descriptor*> pending { desc };
+
+    while (!pending.empty())
+    {
+        auto * msg = pending.back();
+        pending.pop_back();
+
+        int from = d_type_index.at(msg->full_name());
+
+        for (int i = 0; i < msg->field_count(); ++i)
+        {
+            auto * field = msg->field(i);
+            int to;
+
+            if (field->type() == FieldDescriptor::TYPE_MESSAGE ||
+                    field->type() == FieldDescriptor::TYPE_GROUP)
+            {
+                to = add_type(field->message_type()->full_name(), &added);
+                if (added)
+                    pending.push_back(field->message_type());
+            }
+            else if (field->type() == FieldDescriptor::TYPE_ENUM)
+            {
+                to = add_type(field->enum_type()->full_name());
+            }
+            else
+            {
+                continue;
+            }
+
+            d_edges[from].push_back(to);
+        }
+    }
+
+    return id;
+}
+
+void ImpactIndex::add_root(const Descriptor * desc, bool rpc_payload)
+{
+    auto result = d_root_index.emplace(desc->full_name(), int(d_roots.size()));
+    if (result.second)
+    {
+        d_roots.emplace_back();
+        d_roots.back().name = desc->full_name();
+        d_root_type.push_back(add_message(desc));
+    }
+
+    d_roots[result.first->second].rpc_payload |= rpc_payload;
+}
+
+// Tarjan's algorithm, iterative to cope with arbitrarily deep type graphs.
+// Components are numbered in reverse topological order: all edges leaving
+// a component point to components with lower numbers.
+
+void ImpactIndex::condense()
+{
+    int type_count = this->type_count();
+
+    vector<int> index(type_count, -1);
+    vector<int> lowlink(type_count, 0);
+    vector<bool> on_stack(type_count, false);
+    vector<int> stack;
+    vector<std::pair<int, size_t>> path;
+    int next_index = 0;
+
+    d_component.assign(type_count, -1);
+
+    for (int start = 0; start < type_count; ++start)
+    {
+        if (index[start] >= 0)
+            continue;
+
+        index[start] = lowlink[start] = next_index++;
+        stack.push_back(start);
+        on_stack[start] = true;
+        path.emplace_back(start, 0);
+
+        while (!path.empty())
+        {
+            int v = path.back().first;
+            auto & edge = path.back().second;
+
+            if (edge < d_edges[v].size())
+            {
+                int w = d_edges[v][edge++];
+                if (index[w] < 0)
+                {
+                    index[w] = lowlink[w] = next_index++;
+                    stack.push_back(w);
+                    on_stack[w] = true;
+                    path.emplace_back(w, 0);
+                }
+                else if (on_stack[w])
+                {
+                    lowlink[v] = min(lowlink[v], index[w]);
+                }
+                continue;
+            }
+
+            path.pop_back();
+
+            if (!path.empty())
+            {
+                int u = path.back().first;
+                lowlink[u] = min(lowlink[u], lowlink[v]);
+            }
+
+            if (lowlink[v] == index[v])
+            {
+                int component = int(d_component_roots.size());
+                int w;
+                do
+                {
+                    w = stack.back();
+                    stack.pop_back();
+                    on_stack[w] = false;
+                    d_component[w] = component;
+                }
+                while (w != v);
+
+                d_component_roots.emplace_back((d_roots.size() + 63) / 64, 0);
+            }
+        }
+    }
+
+    for (int r = 0; r < int(d_roots.size()); ++r)
+    {
+        auto & bits = d_component_roots[d_component[d_root_type[r]]];
+        bits[r / 64] |= uint64_t(1) << (r % 64);
+    }
+
+    vector<vector<int>> members(d_component_roots.size());
+    for (int v = 0; v < type_count; ++v)
+        members[d_component[v]].push_back(v);
+
+    for (int c = int(members.size()) - 1; c >= 0; --c)
+    {
+        auto & bits = d_component_roots[c];
+        for (int v : members[c])
+        {
+            for (int w : d_edges[v])
+            {
+                int d = d_component[w];
+                if (d == c)
+                    continue;
+                auto & target = d_component_roots[d];
+                for (size_t i = 0; i < bits.size(); ++i)
+                    target[i] |= bits[i];
+            }
+        }
+    }
+}
+
+vector<const ImpactIndex::Root*> ImpactIndex::affected_roots(const string & type_name) const
+{
+    vector<const Root*> roots;
+
+    auto type = d_type_index.find(type_name);
+    if (type == d_type_index.end())
+        return roots;
+
+    auto & bits = d_component_roots[d_component[type->second]];
+    for (size_t i = 0; i < bits.size(); ++i)
+    {
+        uint64_t word = bits[i];
+        while (word)
+        {
+            int bit = __builtin_ctzll(word);
+            roots.push_back(&d_roots[i * 64 + bit]);
+            word &= word - 1;
+        }
+    }
+
+    return roots;
+}
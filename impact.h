@@ -0,0 +1,59 @@
+#pragma once
+
+#include <google/protobuf/descriptor.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+using std::string;
+using std::vector;
+using std::unordered_map;
+
+// Reverse-dependency index over the types reachable from a .proto file.
+//
+// The roots of the index are the top-level messages of the file and the
+// input and output types of its RPC methods. For every type reachable from
+// a root through message fields, the index answers which roots contain it.
+//
+// The type graph is condensed into strongly connected components, each of
+// which stores a bitset of the roots that reach it. A query is then a single
+// hash lookup and a scan of one bitset.
+
+class ImpactIndex
+{
+public:
+    struct Root
+    {
+        string name;
+        bool rpc_payload = false;
+    };
+
+    ImpactIndex(const google::protobuf::FileDescriptor * file);
+
+    // Roots that transitively contain the type with the given full name,
+    // including the type itself if it is a root.
+    vector<const Root*> affected_roots(const string & type_name) const;
+
+    const vector<Root> & roots() const { return d_roots; }
+
+    int type_count() const { return int(d_edges.size()); }
+    int component_count() const { return int(d_component_roots.size()); }
+
+private:
+    int add_type(const string & name, bool * added = nullptr);
+    int add_message(const google::protobuf::Descriptor * desc);
+    void add_root(const google::protobuf::Descriptor * desc, bool rpc_payload);
+    void condense();
+
+    vector<Root> d_roots;
+    vector<int> d_root_type;
+    unordered_map<string, int> d_root_index;
+
+    unordered_map<string, int> d_type_index;
+    vector<vector<int>> d_edges;
+
+    vector<int> d_component;
+    vector<vector<uint64_t>> d_component_roots;
+};
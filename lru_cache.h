@@ -0,0 +1,70 @@
+#pragma once
+
+#include <algorithm>
+#include <list>
+#include <map>
+#include <utility>
+
+// Map holding at most capacity entries, which drops the least recently
+// used entry to make room. Not thread-safe.
+
+template<typename Key, typename Value>
+class LruCache
+{
+public:
+    LruCache(size_t capacity):
+        capacity(std::max<size_t>(1, capacity))
+    {}
+
+    // Returns nullptr if the key is not cached.
+    // Makes the entry the most recently used one.
+    Value * find(const Key & key)
+    {
+        auto entry = index.find(key);
+        if (entry == index.end())
+            return nullptr;
+
+        entries.splice(entries.begin(), entries, entry->second);
+        return &entry->second->second;
+    }
+
+    void insert(const Key & key, Value value)
+    {
+        auto entry = index.find(key);
+        if (entry != index.end())
+        {
+            entry->second->second = std::move(value);
+            entries.splice(entries.begin(), entries, entry->second);
+            return;
+        }
+
+        entries.emplace_front(key, std::move(value));
+        index.emplace(key, entries.begin());
+
+        while (entries.size() > capacity)
+        {
+            index.erase(entries.back().first);
+            entries.pop_back();
+        }
+    }
+
+    void erase(const Key & key)
+    {
+        auto entry = index.find(key);
+        if (entry == index.end())
+            return;
+
+        entries.erase(entry->second);
+        index.erase(entry);
+    }
+
+    size_t size() const { return entries.size(); }
+
+private:
+    using Entries = std::list<std::pair<Key, Value>>;
+
+    size_t capacity;
+    // Most recently used first.
+    Entries entries;
+    std::map<Key, typename Entries::iterator> index;
+};
@@ -0,0 +1,784 @@
+#include "lsp.h"
+#include "mapped_source_tree.h"
+#include "parse_cache.h"
+#include "json/json.hpp"
+
+#include <google/protobuf/descriptor.pb.h>
+#include <google/protobuf/descriptor_database.h>
+
+#include <poll.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <set>
+
+using nlohmann::json;
+using namespace std;
+
+using google::protobuf::DescriptorDatabase;
+using google::protobuf::FileDescriptor;
+using google::protobuf::FileDescriptorProto;
+using google::protobuf::SourceLocation;
+using google::protobuf::compiler::MultiFileErrorCollector;
+using google::protobuf::compiler::SourceTree;
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// LSP messages, framed by a Content-Length header.
+
+class Channel
+{
+public:
+    Channel(int input, int output):
+        input(input),
+        output(output)
+    {}
+
+    // Reads the body of the next message. Returns false at the end of input.
+    bool read(string & body)
+    {
+        while (!take(body))
+        {
+            if (!fill())
+                return false;
+        }
+        return true;
+    }
+
+    // Whether another message has arrived.
+    bool pending()
+    {
+        if (complete())
+            return true;
+
+        pollfd request { input, POLLIN, 0 };
+        return poll(&request, 1, 0) > 0;
+    }
+
+    void write(const json & message)
+    {
+        string body = message.dump();
+        string frame = "Content-Length: " + to_string(body.size()) + "\r\n\r\n" + body;
+
+        for (size_t sent = 0; sent < frame.size(); )
+        {
+            ssize_t length = ::write(output, frame.data() + sent, frame.size() - sent);
+            if (length < 0 and errno == EINTR)
+                continue;
+            if (length < 0)
+                throw runtime_error("Failed to write a message.");
+            sent += length;
+        }
+    }
+
+private:
+    bool fill()
+    {
+        char chunk[64 * 1024];
+
+        while (true)
+        {
+            ssize_t length = ::read(input, chunk, sizeof(chunk));
+            if (length < 0 and errno == EINTR)
+                continue;
+            if (length <= 0)
+                return false;
+
+            buffer.append(chunk, length);
+            return true;
+        }
+    }
+
+    enum Frame { Incomplete, Complete, Invalid };
+
+    // Size of the headers and of the body of the first buffered message,
+    // if its headers are complete. A frame without a valid Content-Length
+    // is Invalid.
+    Frame frame(size_t & header_size, size_t & body_size)
+    {
+        skip_to_header();
+
+        size_t end = buffer.find("\r\n\r\n");
+        if (end == string::npos)
+            return Incomplete;
+
+        header_size = end + 4;
+        body_size = 0;
+        bool valid = false;
+
+        size_t start = 0;
+        while (start < end)
+        {
+            size_t line_end = buffer.find("\r\n", start);
+            string line = buffer.substr(start, line_end - start);
+            start = line_end + 2;
+
+            if (starts_with_field(line))
+                valid = parse_length(line.substr(length_field.size()), body_size);
+        }
+
+        return valid ? Complete : Invalid;
+    }
+
+    // Drops anything before the first Content-Length header, which is left
+    // over from a dropped frame. Other headers before it are ignored anyway.
+    void skip_to_header()
+    {
+        auto found = search(buffer.begin(), buffer.end(), length_field.begin(), length_field.end(),
+                            [](char a, char b){ return tolower(static_cast<unsigned char>(a)) == b; });
+
+        // Keep what may be the start of a header.
+        if (found == buffer.end())
+            found = buffer.end() - std::min(buffer.size(), length_field.size() - 1);
+
+        buffer.erase(buffer.begin(), found);
+    }
+
+    static bool starts_with_field(const string & text)
+    {
+        return text.size() >= length_field.size() and
+            equal(length_field.begin(), length_field.end(), text.begin(),
+                  [](char a, char b){ return a == tolower(static_cast<unsigned char>(b)); });
+    }
+
+    // Decimal length, surrounded by optional spaces.
+    static bool parse_length(const string & text, size_t & length)
+    {
+        size_t first = text.find_first_not_of(" \t");
+        size_t last = text.find_last_not_of(" \t");
+        if (first == string::npos or last - first + 1 > 9)
+            return false;
+
+        length = 0;
+        for (size_t i = first; i <= last; ++i)
+        {
+            if (!isdigit(static_cast<unsigned char>(text[i])))
+                return false;
+            length = length * 10 + (text[i] - '0');
+        }
+
+        return true;
+    }
+
+    bool complete()
+    {
+        size_t header_size, body_size;
+        while (true)
+        {
+            switch (frame(header_size, body_size))
+            {
+            case Incomplete:
+                return false;
+            case Complete:
+                return buffer.size() >= header_size + body_size;
+            case Invalid:
+                drop(header_size);
+                break;
+            }
+        }
+    }
+
+    bool take(string & body)
+    {
+        if (!complete())
+            return false;
+
+        size_t header_size, body_size;
+        frame(header_size, body_size);
+
+        body = buffer.substr(header_size, body_size);
+        buffer.erase(0, header_size + body_size);
+        return true;
+    }
+
+    // Drops the headers of an invalid frame. Its body, if any, is skipped
+    // while looking for the next header.
+    void drop(size_t header_size)
+    {
+        cerr << "Dropped a message without a valid Content-Length header." << endl;
+        buffer.erase(0, header_size);
+    }
+
+    static const string length_field;
+
+    int input;
+    int output;
+    string buffer;
+};
+
+const string Channel::length_field = "content-length:";
+
+string uri_to_path(const string & uri)
+{
+    const string scheme = "file://";
+    if (uri.compare(0, scheme.size(), scheme) != 0)
+        return "";
+
+    string path;
+    for (size_t i = scheme.size(); i < uri.size(); ++i)
+    {
+        if (uri[i] == '%' and i + 2 < uri.size() and
+                isxdigit(static_cast<unsigned char>(uri[i + 1])) and isxdigit(static_cast<unsigned char>(uri[i + 2])))
+        {
+            path += char(stoi(uri.substr(i + 1, 2), nullptr, 16));
+            i += 2;
+        }
+        else
+        {
+            path += uri[i];
+        }
+    }
+
+    return path;
+}
+
+// Descriptor database over the workspace, where open documents take the
+// place of the files on disk. Parsed files are kept with their content,
+// and parsed again only when the content changes.
+
+class WorkspaceDatabase : public DescriptorDatabase
+{
+public:
+    WorkspaceDatabase(const vector<string> & roots, const map<string, string> & buffers):
+        roots(roots),
+        buffers(buffers)
+    {}
+
+    // Starts a new load, with parse errors going to errors.
+    void begin_load(MultiFileErrorCollector * errors)
+    {
+        this->errors = errors;
+        // Files on disk may have changed since the last load.
+        tree.reset();
+    }
+
+    bool FindFileByName(const string & filename, FileDescriptorProto * output) override
+    {
+        string content;
+        if (!read(filename, content))
+        {
+            if (errors)
+                errors->AddError(filename, -1, 0, "File not found.");
+            return false;
+        }
+
+        auto & parsed = files[filename];
+        if (!parsed.file or parsed.content != content)
+        {
+            parsed.file = parse_file(filename, content, errors);
+            if (!parsed.file)
+            {
+                files.erase(filename);
+                return false;
+            }
+            parsed.content = std::move(content);
+        }
+
+        *output = *parsed.file;
+        return true;
+    }
+
+    // Files are only found by name; symbols are resolved by the pool.
+    bool FindFileContainingSymbol(const string &, FileDescriptorProto *) override { return false; }
+    bool FindFileContainingExtension(const string &, int, FileDescriptorProto *) override { return false; }
+
+private:
+    bool read(const string & filename, string & content)
+    {
+        auto buffer = buffers.find(filename);
+        if (buffer != buffers.end())
+        {
+            content = buffer->second;
+            return true;
+        }
+
+        if (!tree)
+            tree = open_source_tree(roots);
+
+        unique_ptr<google::protobuf::io::ZeroCopyInputStream> input(tree->Open(filename));
+        if (!input)
+            return false;
+
+        const void * data;
+        int size;
+        while (input->Next(&data, &size))
+            content.append(static_cast<const char*>(data), size);
+
+        return true;
+    }
+
+    struct ParsedFile
+    {
+        string content;
+        shared_ptr<const FileDescriptorProto> file;
+    };
+
+    vector<string> roots;
+    const map<string, string> & buffers;
+    shared_ptr<SourceTree> tree;
+    MultiFileErrorCollector * errors = nullptr;
+    map<string, ParsedFile> files;
+};
+
+// Converts a column of the protobuf tokenizer, which counts bytes and
+// expands tabs to multiples of 8, to the UTF-16 code units LSP counts.
+int utf16_column(const string & text, int line, int column)
+{
+    size_t start = 0;
+    for (int i = 0; i < line; ++i)
+    {
+        start = text.find('\n', start);
+        if (start == string::npos)
+            return column;
+        ++start;
+    }
+
+    int tokenizer_column = 0;
+    int units = 0;
+
+    for (size_t i = start; i < text.size() and text[i] != '\n' and tokenizer_column < column; ++i)
+    {
+        unsigned char c = text[i];
+        if (c == '\t')
+            tokenizer_column += 8 - tokenizer_column % 8;
+        else
+            ++tokenizer_column;
+
+        // Characters outside the basic plane take two units.
+        if ((c & 0xC0) != 0x80)
+            units += c >= 0xF0 ? 2 : 1;
+    }
+
+    return units;
+}
+
+json lsp_diagnostic(int line, int column, int severity, const string & message)
+{
+    line = std::max(line, 0);
+    column = std::max(column, 0);
+
+    // To the end of the line.
+    return {
+        { "range", {
+            { "start", { { "line", line }, { "character", column } } },
+            { "end", { { "line", line + 1 }, { "character", 0 } } } } },
+        { "severity", severity },
+        { "source", "protobuf-spec-compare" },
+        { "message", message }
+    };
+}
+
+// Places the items of a comparison report at the elements of the document
+// they concern, in the document's text.
+
+class ReportLocator
+{
+public:
+    ReportLocator(Source & source, const string & text, json & diagnostics):
+        file(source.file_descriptor()),
+        text(text),
+        pool(source.pool()),
+        diagnostics(diagnostics)
+    {}
+
+    void add(const Comparison::Section & section)
+    {
+        add(section, Place(), "", nullptr, nullptr);
+    }
+
+private:
+    struct Place
+    {
+        int line = 0;
+        int column = 0;
+    };
+
+    // Moves place to the element, if it is in the document.
+    template<typename Element>
+    void locate(const Element * element, Place & place)
+    {
+        SourceLocation location;
+        if (!element or element->file() != file or !element->GetSourceLocation(&location))
+            return;
+
+        place.line = location.start_line;
+        place.column = utf16_column(text, location.start_line, location.start_column);
+    }
+
+    void add(const Comparison::Section & section, Place place, string context,
+             const Descriptor * message, const EnumDescriptor * enum_type)
+    {
+        switch (section.type)
+        {
+        case Comparison::Message_Comparison:
+            message = pool->FindMessageTypeByName(section.b);
+            locate(message, place);
+            context = section.b;
+            break;
+        case Comparison::Message_Field_Comparison:
+            if (message)
+                locate(message->FindFieldByName(section.b), place);
+            context += "." + section.b;
+            break;
+        case Comparison::Enum_Comparison:
+            enum_type = pool->FindEnumTypeByName(section.b);
+            locate(enum_type, place);
+            context = section.b;
+            break;
+        case Comparison::Enum_Value_Comparison:
+            if (enum_type)
+                locate(enum_type->FindValueByName(section.b), place);
+            context += "." + section.b;
+            break;
+        default:
+            break;
+        }
+
+        for (auto & item : section.items)
+        {
+            Place item_place = place;
+
+            switch (item.type)
+            {
+            case Comparison::File_Message_Added:
+            case Comparison::File_Message_Moved:
+                locate(pool->FindMessageTypeByName(item.b), item_place);
+                break;
+            case Comparison::File_Enum_Added:
+            case Comparison::File_Enum_Moved:
+                locate(pool->FindEnumTypeByName(item.b), item_place);
+                break;
+            case Comparison::Message_Field_Added:
+                if (message)
+                    locate(message->FindFieldByName(item.b), item_place);
+                break;
+            case Comparison::Enum_Value_Added:
+                if (enum_type)
+                    locate(enum_type->FindValueByName(item.b), item_place);
+                break;
+            default:
+                break;
+            }
+
+            string text = item.message();
+            if (!context.empty())
+                text = context + ": " + text;
+
+            diagnostics.push_back(lsp_diagnostic(item_place.line, item_place.column, 2, text));
+        }
+
+        for (auto & subsection : section.subsections)
+            add(subsection, place, context, message, enum_type);
+    }
+
+    const FileDescriptor * file;
+    const string & text;
+    const google::protobuf::DescriptorPool * pool;
+    json & diagnostics;
+};
+
+struct Document
+{
+    string uri;
+    string path;
+    // Files the document imported when last checked, directly or indirectly.
+    set<string> imports;
+};
+
+class LanguageServer
+{
+public:
+    LanguageServer(const vector<string> & baseline_roots, const vector<string> & workspace_roots,
+                   const Comparison::Options & options, int input, int output):
+        options(options),
+        channel(input, output),
+        workspace(fs::absolute(workspace_roots.front()).lexically_normal()),
+        baseline_importer(make_shared<Source>(open_source_tree(baseline_roots))),
+        database(make_shared<WorkspaceDatabase>(workspace_roots, buffers))
+    {}
+
+    int run()
+    {
+        string body;
+
+        while (channel.read(body))
+        {
+            json message;
+
+            try
+            {
+                message = json::parse(body);
+            }
+            catch (json::exception &)
+            {
+                channel.write({ { "jsonrpc", "2.0" }, { "id", nullptr },
+                                { "error", { { "code", -32700 }, { "message", "Parse error" } } } });
+                continue;
+            }
+
+            try
+            {
+                if (!handle(message))
+                    return shutting_down ? 0 : 1;
+            }
+            catch (json::exception & e)
+            {
+                if (message.count("id"))
+                    channel.write({ { "jsonrpc", "2.0" }, { "id", message["id"] },
+                                    { "error", { { "code", -32602 }, { "message", e.what() } } } });
+            }
+
+            // Edits which already arrived replace the ones not yet checked.
+            if (!channel.pending())
+                check_dirty();
+        }
+
+        return 1;
+    }
+
+private:
+    // Returns false on exit.
+    bool handle(const json & message)
+    {
+        string method = message.value("method", "");
+        bool is_request = message.count("id") != 0;
+
+        if (method == "initialize")
+        {
+            channel.write({ { "jsonrpc", "2.0" }, { "id", message["id"] }, { "result", {
+                { "capabilities", { { "textDocumentSync", { { "openClose", true }, { "change", 1 } } } } },
+                { "serverInfo", { { "name", "protobuf-spec-compare" } } } } } });
+        }
+        else if (method == "shutdown")
+        {
+            shutting_down = true;
+            channel.write({ { "jsonrpc", "2.0" }, { "id", message["id"] }, { "result", nullptr } });
+        }
+        else if (method == "exit")
+        {
+            return false;
+        }
+        else if (method == "textDocument/didOpen")
+        {
+            auto & document = message.at("params").at("textDocument");
+            update(document.at("uri").get<string>(), document.at("text").get<string>());
+        }
+        else if (method == "textDocument/didChange")
+        {
+            auto & params = message.at("params");
+            auto & changes = params.at("contentChanges");
+            // Full synchronization: the last change holds the whole text.
+            if (!changes.empty())
+                update(params.at("textDocument").at("uri").get<string>(), changes.back().at("text").get<string>());
+        }
+        else if (method == "textDocument/didClose")
+        {
+            close(message.at("params").at("textDocument").at("uri").get<string>());
+        }
+        else if (is_request)
+        {
+            channel.write({ { "jsonrpc", "2.0" }, { "id", message["id"] },
+                            { "error", { { "code", -32601 }, { "message", "Method not found: " + method } } } });
+        }
+
+        return true;
+    }
+
+    void update(const string & uri, const string & text)
+    {
+        auto relative = fs::path(uri_to_path(uri)).lexically_normal().lexically_relative(workspace).generic_string();
+        if (relative.empty() or relative.compare(0, 2, "..") == 0 or fs::path(relative).extension() != ".proto")
+            return;
+
+        auto & document = documents[uri];
+        document.uri = uri;
+        document.path = relative;
+        buffers[relative] = text;
+
+        dirty.insert(uri);
+        for (auto & other : documents)
+        {
+            if (other.second.imports.count(relative))
+                dirty.insert(other.first);
+        }
+    }
+
+    void close(const string & uri)
+    {
+        auto document = documents.find(uri);
+        if (document == documents.end())
+            return;
+
+        string path = document->second.path;
+        buffers.erase(path);
+        documents.erase(document);
+        dirty.erase(uri);
+
+        channel.write({ { "jsonrpc", "2.0" }, { "method", "textDocument/publishDiagnostics" },
+                        { "params", { { "uri", uri }, { "diagnostics", json::array() } } } });
+
+        // Importers now see the file on disk.
+        for (auto & other : documents)
+        {
+            if (other.second.imports.count(path))
+                dirty.insert(other.first);
+        }
+    }
+
+    void check_dirty()
+    {
+        for (auto & uri : dirty)
+        {
+            auto document = documents.find(uri);
+            if (document != documents.end())
+                check(document->second);
+        }
+        dirty.clear();
+    }
+
+    void check(Document & document)
+    {
+        auto start = chrono::steady_clock::now();
+
+        json diagnostics = json::array();
+        const string & text = buffers[document.path];
+
+        auto add_diagnostics = [&](const Diagnostics & found)
+        {
+            for (auto & diagnostic : found.items)
+            {
+                int severity = diagnostic.severity == Diagnostic::Error ? 1 : 2;
+                if (diagnostic.file == document.path)
+                    diagnostics.push_back(lsp_diagnostic(diagnostic.line, utf16_column(text, diagnostic.line, diagnostic.column),
+                                                         severity, diagnostic.message));
+                else
+                    diagnostics.push_back(lsp_diagnostic(0, 0, severity, diagnostic.file + ": " + diagnostic.message));
+            }
+        };
+
+        auto errors = make_shared<ErrorCollector>();
+        database->begin_load(errors.get());
+
+        shared_ptr<Source> current;
+
+        try
+        {
+            current = make_shared<Source>(document.path, database);
+        }
+        catch (SourceError & e)
+        {
+            // Parse errors are collected by the database.
+            if (errors->diagnostics().items.empty())
+                add_diagnostics(e.diagnostics());
+        }
+
+        add_diagnostics(errors->diagnostics());
+
+        if (current)
+        {
+            document.imports = imports(current->file_descriptor());
+
+            auto baseline = baseline_source(document.path);
+            if (baseline)
+            {
+                Comparison comparison(options);
+                comparison.run(*baseline, *current, { "." });
+
+                ReportLocator(*current, text, diagnostics).add(comparison.root);
+            }
+        }
+
+        channel.write({ { "jsonrpc", "2.0" }, { "method", "textDocument/publishDiagnostics" },
+                        { "params", { { "uri", document.uri }, { "diagnostics", diagnostics } } } });
+
+        auto elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - start);
+        cerr << document.path << ": " << diagnostics.size() << " diagnostics in " << elapsed.count() << " ms" << endl;
+    }
+
+    // The file in the baseline, or nullptr if it is not there.
+    shared_ptr<Source> baseline_source(const string & path)
+    {
+        auto found = baseline.find(path);
+        if (found != baseline.end())
+            return found->second;
+
+        shared_ptr<Source> source;
+
+        try
+        {
+            source = make_shared<Source>(path, *baseline_importer);
+        }
+        catch (std::exception &)
+        {}
+
+        baseline[path] = source;
+        return source;
+    }
+
+    static set<string> imports(const FileDescriptor * file)
+    {
+        set<string> names;
+        vector<const FileDescriptor*> pending { file };
+
+        while (!pending.empty())
+        {
+            auto * current = pending.back();
+            pending.pop_back();
+
+            for (int i = 0; i < current->dependency_count(); ++i)
+            {
+                if (names.insert(current->dependency(i)->name()).second)
+                    pending.push_back(current->dependency(i));
+            }
+        }
+
+        return names;
+    }
+
+    Comparison::Options options;
+    Channel channel;
+    fs::path workspace;
+
+    // Shares the files loaded for all baseline Sources.
+    shared_ptr<Source> baseline_importer;
+    map<string, shared_ptr<Source>> baseline;
+
+    // Path -> text of the open documents.
+    map<string, string> buffers;
+    shared_ptr<WorkspaceDatabase> database;
+
+    // By URI.
+    map<string, Document> documents;
+    set<string> dirty;
+
+    bool shutting_down = false;
+};
+
+}
+
+int run_language_server(const vector<string> & baseline_roots,
+                        const vector<string> & workspace_roots,
+                        const Comparison::Options & options,
+                        int input, int output)
+{
+    // Files may be edited while the server holds them.
+    MappedFile::copy_files(true);
+
+    try
+    {
+        return LanguageServer(baseline_roots, workspace_roots, options, input, output).run();
+    }
+    catch (std::exception & e)
+    {
+        cerr << e.what() << endl;
+        return 1;
+    }
+}
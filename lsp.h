@@ -0,0 +1,27 @@
+#pragma once
+
+#include "comparison.h"
+
+#include <vector>
+
+// Language server speaking LSP over the input and output file descriptors,
+// standard input and output by default.
+//
+// Open .proto documents under the first of workspace_roots are parsed from
+// the editor's buffers, with their imports from other open buffers or the
+// workspace roots, and compared as whole files with the same paths under
+// baseline_roots (e.g. "git:HEAD"). Parse errors and the differences are
+// published as diagnostics, at the changed element where it is in the
+// document, and otherwise at its first line.
+//
+// The baseline is loaded once per file and kept. Parsed files are kept
+// too, so an edit reparses only the edited buffer. Edits which arrive
+// while a document is being checked are merged, and open documents which
+// import an edited one are checked again. The time of each check is logged
+// to standard error.
+//
+// Returns 0 after an orderly shutdown, 1 otherwise.
+int run_language_server(const vector<string> & baseline_roots,
+                        const vector<string> & workspace_roots,
+                        const Comparison::Options & options,
+                        int input = 0, int output = 1);
@@ -1,48 +1,348 @@
 #include "comparison.h"
+#include "batch.h"
+#include "chain.h"
+#include "daemon.h"
+#include "directory.h"
+#include "lsp.h"
+#include "matrix.h"
+#include "timeline.h"
+#include "watch.h"
 
 #include <iostream>
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
 
 using namespace std;
 
-int main(int argc, char * argv[])
+static
+void print_usage()
 {
-    if (argc < 6)
-    {
-        cerr << "Expected arguments: root-dir1 file1 root-dir2 file2 type [--binary]" << endl;
-        cerr << "Use '.' for <type> to compare all messages and enums in given files." << endl;
-        return 1;
-    }
+    cerr << "Expected arguments: root-dir1 file1 root-dir2 file2 [type] [options]" << endl;
+    cerr << "                or: --batch manifest.jsonl [options]" << endl;
+    cerr << "                or: --chain root-dir1 file1 root-dir2 file2 [root-dir3 file3 ...] [options]" << endl;
+    cerr << "                or: --matrix root-dir1 file1 root-dir2 file2 [root-dir3 file3 ...] [options]" << endl;
+    cerr << "                or: --dirs root-dir1 root-dir2 [options]" << endl;
+    cerr << "                or: --daemon <socket-path> [options]" << endl;
+    cerr << "                or: --lsp baseline-root workspace-root [options]" << endl;
+    cerr << "                or: --timeline <rev-range> root-dir file [options]" << endl;
+    cerr << "                or: --bisect <good-rev> <bad-rev> root-dir file [options]" << endl;
+    cerr << "Use '.' for <type> to compare all messages and enums in given files." << endl;
+    cerr << "Options:" << endl;
+    cerr << "  --type <type>       Compare this type too; may be repeated and may be a glob pattern." << endl;
+    cerr << "  --include1 <root>   Search imports of file1 in this root too; may be repeated." << endl;
+    cerr << "  --include2 <root>   Search imports of file2 in this root too; may be repeated." << endl;
+    cerr << "  --binary            Compare binary compatibility (match fields and values by number)." << endl;
+    cerr << "  --impact            List RPC payload types affected by each changed type." << endl;
+    cerr << "  --renames           Detect renamed fields." << endl;
+    cerr << "  --moves             Detect moved and renamed types." << endl;
+    cerr << "  --map <file>        Pair types according to a mapping file." << endl;
+    cerr << "  --changed-files <f> Compare whole files only if affected by the paths listed in f ('-' for stdin)." << endl;
+    cerr << "  --diagnostics-json  Print parser diagnostics as JSON (when comparing two files)." << endl;
+    cerr << "  --watch             Print an updated report whenever a loaded file changes." << endl;
+    cerr << "  --batch <file>      Run the comparisons listed in a JSON lines manifest." << endl;
+    cerr << "  --dirs              Compare all .proto files under two directories, paired by path." << endl;
+    cerr << "  --chain             Compare each version in a list with the next one." << endl;
+    cerr << "  --matrix            Compare every ordered pair of versions in a list." << endl;
+    cerr << "  --timeline <range>  Check each commit of a git revision range against the previous one." << endl;
+    cerr << "  --bisect <g> <b>    Find the first commit where types differ from the good revision." << endl;
+    cerr << "  --lsp               Serve the language server protocol on stdin and stdout." << endl;
+    cerr << "  --daemon <path>     Serve comparison requests on a Unix domain socket." << endl;
+    cerr << "  --cache-size <n>    Number of parsed sources the daemon keeps (default: 64)." << endl;
+    cerr << "  --jobs <n>          Number of worker threads (default: one per core)." << endl;
+}
 
+int main(int argc, char * argv[])
+{
     Comparison::Options options;
+    vector<string> positional;
+    vector<string> selectors;
+    vector<string> includes1;
+    vector<string> includes2;
+    string batch_manifest;
+    string daemon_socket;
+    string timeline_range;
+    string bisect_good;
+    string bisect_bad;
+    unsigned int jobs = 0;
+    size_t cache_size = 64;
+    bool chain = false;
+    bool dirs = false;
+    bool diagnostics_json = false;
+    bool matrix = false;
+    bool watch = false;
+    bool lsp = false;
 
-    if (argc > 6)
+    for (int i = 1; i < argc; ++i)
     {
-        for (int i = 6; i < argc; ++i)
+        string arg = argv[i];
+        if (arg.compare(0, 2, "--") != 0)
+        {
+            positional.push_back(arg);
+        }
+        else if (arg == "--binary")
+        {
+            options.binary = true;
+        }
+        else if (arg == "--impact")
+        {
+            options.impact = true;
+        }
+        else if (arg == "--renames")
+        {
+            options.detect_renames = true;
+        }
+        else if (arg == "--moves")
+        {
+            options.detect_moves = true;
+        }
+        else if (arg == "--type" and i + 1 < argc)
+        {
+            selectors.push_back(argv[++i]);
+        }
+        else if (arg == "--include1" and i + 1 < argc)
+        {
+            includes1.push_back(argv[++i]);
+        }
+        else if (arg == "--include2" and i + 1 < argc)
+        {
+            includes2.push_back(argv[++i]);
+        }
+        else if (arg == "--batch" and i + 1 < argc)
+        {
+            batch_manifest = argv[++i];
+        }
+        else if (arg == "--changed-files" and i + 1 < argc)
+        {
+            try
+            {
+                options.changed_files = make_shared<ChangeSet>(ChangeSet::load(argv[++i]));
+            }
+            catch (std::exception & e)
+            {
+                cerr << e.what() << endl;
+                return 1;
+            }
+        }
+        else if (arg == "--diagnostics-json")
         {
-            string arg = argv[i];
-            if (arg == "--binary")
+            diagnostics_json = true;
+        }
+        else if (arg == "--watch")
+        {
+            watch = true;
+        }
+        else if (arg == "--lsp")
+        {
+            lsp = true;
+        }
+        else if (arg == "--dirs")
+        {
+            dirs = true;
+        }
+        else if (arg == "--chain")
+        {
+            chain = true;
+        }
+        else if (arg == "--matrix")
+        {
+            matrix = true;
+        }
+        else if (arg == "--timeline" and i + 1 < argc)
+        {
+            timeline_range = argv[++i];
+        }
+        else if (arg == "--bisect" and i + 2 < argc)
+        {
+            bisect_good = argv[++i];
+            bisect_bad = argv[++i];
+        }
+        else if (arg == "--daemon" and i + 1 < argc)
+        {
+            daemon_socket = argv[++i];
+        }
+        else if (arg == "--cache-size" and i + 1 < argc)
+        {
+            cache_size = std::max(1, atoi(argv[++i]));
+        }
+        else if (arg == "--jobs" and i + 1 < argc)
+        {
+            jobs = std::max(0, atoi(argv[++i]));
+        }
+        else if (arg == "--map" and i + 1 < argc)
+        {
+            try
             {
-                options.binary = true;
+                options.type_mapping = make_shared<TypeMapping>(TypeMapping::load(argv[++i]));
             }
-            else
+            catch (std::exception & e)
             {
-                cerr << "Unknown option: " << arg << endl;
+                cerr << e.what() << endl;
                 return 1;
             }
         }
+        else
+        {
+            cerr << "Unknown option: " << arg << endl;
+            return 1;
+        }
+    }
+
+    // Modes other than comparing two files, once or with --watch.
+    int other_modes = !batch_manifest.empty() + !daemon_socket.empty() + lsp + dirs +
+        !timeline_range.empty() + !bisect_good.empty() + chain + matrix;
+    bool other_mode = other_modes > 0;
+
+    // At most one mode is run. Only the comparison of two files is watched,
+    // and the other modes report diagnostics in their own way.
+    if (other_modes > 1 or (watch and other_mode) or (diagnostics_json and (other_mode or watch)))
+    {
+        print_usage();
+        return 1;
     }
 
+    // Import roots are given per side, which only two files and the
+    // language server have.
+    if ((!includes1.empty() or !includes2.empty()) and other_mode and !lsp)
+    {
+        print_usage();
+        return 1;
+    }
+
+    if (!batch_manifest.empty())
+    {
+        if (!positional.empty() or !selectors.empty())
+        {
+            print_usage();
+            return 1;
+        }
+
+        return run_batch(batch_manifest, options, jobs);
+    }
+
+    if (!daemon_socket.empty())
+    {
+        if (!positional.empty() or !selectors.empty())
+        {
+            print_usage();
+            return 1;
+        }
+
+        return run_daemon(daemon_socket, options, jobs, cache_size);
+    }
+
+    if (lsp)
+    {
+        if (positional.size() != 2 or !selectors.empty())
+        {
+            print_usage();
+            return 1;
+        }
+
+        includes1.insert(includes1.begin(), positional[0]);
+        includes2.insert(includes2.begin(), positional[1]);
+
+        return run_language_server(includes1, includes2, options);
+    }
+
+    if (dirs)
+    {
+        if (positional.size() != 2)
+        {
+            print_usage();
+            return 1;
+        }
+
+        if (selectors.empty())
+            selectors.push_back(".");
+
+        return run_directories(positional[0], positional[1], selectors, options, jobs);
+    }
+
+    if (!timeline_range.empty() or !bisect_good.empty())
+    {
+        if (positional.size() != 2)
+        {
+            print_usage();
+            return 1;
+        }
+
+        if (selectors.empty())
+            selectors.push_back(".");
+
+        if (!bisect_good.empty())
+            return run_bisect(bisect_good, bisect_bad, positional[0], positional[1], selectors, options);
+        else
+            return run_timeline(timeline_range, positional[0], positional[1], selectors, options);
+    }
+
+    if (chain or matrix)
+    {
+        if (positional.size() < 4 or positional.size() % 2)
+        {
+            print_usage();
+            return 1;
+        }
+
+        vector<pair<string, string>> versions;
+        for (size_t i = 0; i < positional.size(); i += 2)
+            versions.emplace_back(positional[i], positional[i+1]);
+
+        if (selectors.empty())
+            selectors.push_back(".");
+
+        if (matrix)
+            return run_matrix(versions, selectors, options, jobs);
+        else
+            return run_chain(versions, selectors, options);
+    }
+
+    if (positional.size() == 5)
+    {
+        selectors.insert(selectors.begin(), positional[4]);
+    }
+
+    if (positional.size() < 4 or positional.size() > 5 or selectors.empty())
+    {
+        print_usage();
+        return 1;
+    }
+
+    includes1.insert(includes1.begin(), positional[0]);
+    includes2.insert(includes2.begin(), positional[2]);
+
+    if (watch)
+        return run_watch(includes1, positional[1], includes2, positional[3], selectors, options);
+
     Comparison comparison(options);
 
+    auto print_diagnostics = [&](const Diagnostics & diagnostics)
+    {
+        if (diagnostics.items.empty() and !diagnostics.dropped)
+            return;
+        if (diagnostics_json)
+            cerr << diagnostics.json() << endl;
+        else
+            diagnostics.print(cerr);
+    };
+
     try
     {
-        Source source1(argv[2], argv[1]);
-        Source source2(argv[4], argv[3]);
-        string message_name = argv[5];
-        if (message_name == ".")
-            comparison.compare(source1, source2);
+        Source source1(positional[1], includes1);
+        print_diagnostics(source1.diagnostics());
+
+        Source source2(positional[3], includes2);
+        print_diagnostics(source2.diagnostics());
+
+        comparison.run(source1, source2, selectors);
+    }
+    catch (SourceError & e)
+    {
+        if (diagnostics_json)
+            cerr << e.diagnostics().json() << endl;
         else
-            comparison.compare(source1, message_name, source2, message_name);
+            cerr << e.what() << endl;
+        return 1;
     }
     catch(std::exception & e)
     {
@@ -50,9 +350,7 @@ int main(int argc, char * argv[])
         return 1;
     }
 
-    comparison.root.trim();
     comparison.root.print();
 
     return 0;
 }
-
@@ -0,0 +1,249 @@
+#include "mapped_source_tree.h"
+
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+
+#include <atomic>
+#include <cerrno>
+#include <mutex>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+using google::protobuf::io::ArrayInputStream;
+using google::protobuf::io::ZeroCopyInputStream;
+
+namespace {
+
+// Size of the blocks handed to the parser, so that it can be stopped
+// between blocks without copying.
+const int stream_block_size = 64 * 1024;
+
+// Keeps the mapping alive while the parser reads it.
+class MappedInputStream : public ArrayInputStream
+{
+public:
+    MappedInputStream(shared_ptr<const MappedFile> file):
+        ArrayInputStream(file->data(), int(file->size()), stream_block_size),
+        file(file)
+    {}
+
+private:
+    shared_ptr<const MappedFile> file;
+};
+
+// Whether a relative path has no empty, "." or ".." components, as
+// DiskSourceTree requires. Other spellings of a path would load the same
+// file twice, under different names.
+bool is_canonical_path(const string & filename)
+{
+    size_t start = 0;
+    while (start <= filename.size())
+    {
+        size_t end = filename.find('/', start);
+        if (end == string::npos)
+            end = filename.size();
+
+        // A trailing slash is canonical, and names a directory anyway.
+        bool last = end == filename.size();
+        if ((end == start and !last) or
+                filename.compare(start, end - start, ".") == 0 or
+                filename.compare(start, end - start, "..") == 0)
+            return false;
+
+        start = end + 1;
+    }
+
+    return true;
+}
+
+// By device and inode, so that different paths to a file share it.
+using FileKey = pair<unsigned long, unsigned long>;
+
+// Files currently held by any caller.
+struct OpenFiles
+{
+    std::mutex mutex;
+    map<FileKey, weak_ptr<const MappedFile>> files;
+};
+
+// Never destroyed, since files may be released during exit.
+OpenFiles & open_files()
+{
+    static auto * files = new OpenFiles;
+    return *files;
+}
+
+atomic<bool> copying_files { false };
+
+// Releases a file and its entry, unless the entry was replaced.
+void release(const FileKey & key, const MappedFile * file)
+{
+    {
+        auto & open = open_files();
+        lock_guard<std::mutex> lock(open.mutex);
+
+        auto entry = open.files.find(key);
+        if (entry != open.files.end() and entry->second.expired())
+            open.files.erase(entry);
+    }
+
+    delete file;
+}
+
+// Reads up to size bytes, fewer if the file was truncated meanwhile.
+bool read_file(int fd, size_t size, string & content)
+{
+    content.resize(size);
+
+    size_t done = 0;
+    while (done < size)
+    {
+        ssize_t length = pread(fd, &content[done], size - done, done);
+        if (length < 0 and errno == EINTR)
+            continue;
+        if (length < 0)
+            return false;
+        if (length == 0)
+            break;
+        done += length;
+    }
+
+    content.resize(done);
+    return true;
+}
+
+}
+
+void MappedFile::copy_files(bool copy)
+{
+    copying_files = copy;
+}
+
+size_t MappedFile::held_count()
+{
+    auto & open = open_files();
+    lock_guard<std::mutex> lock(open.mutex);
+    return open.files.size();
+}
+
+shared_ptr<const MappedFile> MappedFile::open(const string & path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return nullptr;
+
+    struct stat status;
+    if (fstat(fd, &status) != 0 or !S_ISREG(status.st_mode))
+    {
+        close(fd);
+        return nullptr;
+    }
+
+    long long modified = status.st_mtim.tv_sec * 1000000000LL + status.st_mtim.tv_nsec;
+    FileKey key { status.st_dev, status.st_ino };
+    auto & open = open_files();
+
+    // Released only after the lock, since releasing a file takes it.
+    shared_ptr<const MappedFile> file;
+
+    {
+        lock_guard<std::mutex> lock(open.mutex);
+
+        auto entry = open.files.find(key);
+        if (entry != open.files.end())
+            file = entry->second.lock();
+    }
+
+    if (file and file->modified == modified and file->d_size == size_t(status.st_size))
+    {
+        close(fd);
+        return file;
+    }
+
+    unique_ptr<MappedFile> loaded(new MappedFile);
+    loaded->modified = modified;
+    loaded->d_size = status.st_size;
+
+    if (copying_files)
+    {
+        if (!read_file(fd, loaded->d_size, loaded->copy))
+        {
+            close(fd);
+            return nullptr;
+        }
+        loaded->d_data = loaded->copy.data();
+        loaded->d_size = loaded->copy.size();
+    }
+    else if (loaded->d_size)
+    {
+        void * data = mmap(nullptr, loaded->d_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED)
+        {
+            close(fd);
+            return nullptr;
+        }
+        madvise(data, loaded->d_size, MADV_SEQUENTIAL);
+        loaded->d_data = static_cast<const char*>(data);
+        loaded->mapped = true;
+    }
+    else
+    {
+        loaded->d_data = "";
+    }
+
+    close(fd);
+
+    shared_ptr<const MappedFile> shared(loaded.release(), [key](const MappedFile * file) { release(key, file); });
+
+    lock_guard<std::mutex> lock(open.mutex);
+    open.files[key] = shared;
+    return shared;
+}
+
+MappedFile::~MappedFile()
+{
+    if (mapped)
+        munmap(const_cast<char*>(d_data), d_size);
+}
+
+MappedSourceTree::MappedSourceTree(const string & root_dir):
+    root_dir(root_dir)
+{
+    while (this->root_dir.size() > 1 and this->root_dir.back() == '/')
+        this->root_dir.pop_back();
+}
+
+ZeroCopyInputStream * MappedSourceTree::Open(const string & filename)
+{
+    // A root maps relative paths only.
+    if (filename.empty() or filename[0] == '/')
+    {
+        last_error = "File not found.";
+        return nullptr;
+    }
+
+    if (!is_canonical_path(filename))
+    {
+        last_error = "Backslashes, consecutive slashes, \".\", or \"..\" are not allowed in the virtual path";
+        return nullptr;
+    }
+
+    auto & file = files[filename];
+
+    if (!file)
+    {
+        file = MappedFile::open(root_dir.empty() ? filename : root_dir + "/" + filename);
+        if (!file)
+        {
+            files.erase(filename);
+            last_error = "File not found.";
+            return nullptr;
+        }
+    }
+
+    return new MappedInputStream(file);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <google/protobuf/compiler/importer.h>
+
+#include <map>
+#include <memory>
+#include <string>
+
+// A read-only memory mapping of a whole file.
+
+class MappedFile
+{
+public:
+    // Returns nullptr if the file can not be opened or mapped.
+    // Mappings of an unchanged file are shared between all callers,
+    // as long as any of them holds one, even when opened by other paths.
+    static std::shared_ptr<const MappedFile> open(const std::string & path);
+
+    // Whether files opened from now on are read into memory instead of
+    // mapped. Reading a mapping faults if the file is truncated meanwhile,
+    // which processes that keep running while files are edited must avoid.
+    static void copy_files(bool copy);
+
+    // Number of files held by any caller.
+    static size_t held_count();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile & operator=(const MappedFile &) = delete;
+    ~MappedFile();
+
+    const char * data() const { return d_data; }
+    size_t size() const { return d_size; }
+
+private:
+    MappedFile() {}
+
+    const char * d_data = nullptr;
+    size_t d_size = 0;
+    bool mapped = false;
+    // The content, when copied.
+    std::string copy;
+    // Modification time in nanoseconds, to tell file versions apart.
+    long long modified = 0;
+};
+
+// Files in a directory on disk, memory-mapped and handed to the parser
+// without copying. The tree keeps the mappings of all opened files, so
+// that the same files opened through another tree reuse them.
+
+class MappedSourceTree : public google::protobuf::compiler::SourceTree
+{
+public:
+    MappedSourceTree(const std::string & root_dir);
+
+    google::protobuf::io::ZeroCopyInputStream * Open(const std::string & filename) override;
+    std::string GetLastErrorMessage() override { return last_error; }
+
+private:
+    std::string root_dir;
+    std::map<std::string, std::shared_ptr<const MappedFile>> files;
+    std::string last_error;
+};
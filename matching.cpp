@@ -0,0 +1,417 @@
+#include "matching.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <numeric>
+#include <string>
+#include <unordered_map>
+
+using namespace std;
+
+using google::protobuf::Descriptor;
+using google::protobuf::EnumDescriptor;
+
+// Numbers are given in declaration order. When a number occurs several
+// times on one side (enum aliases), every occurrence on the first side is
+// paired with the earliest declared occurrence on the second side.
+
+static
+Matching merge_join(const vector<int> & numbers1, const vector<int> & numbers2)
+{
+    Matching matching(numbers1.size(), numbers2.size());
+
+    auto sorted_order = [](const vector<int> & numbers)
+    {
+        vector<int> order(numbers.size());
+        iota(order.begin(), order.end(), 0);
+        stable_sort(order.begin(), order.end(), [&](int a, int b) { return numbers[a] < numbers[b]; });
+        return order;
+    };
+
+    auto sorted_numbers = [](const vector<int> & numbers, const vector<int> & order)
+    {
+        vector<int> sorted(order.size());
+        for (size_t i = 0; i < order.size(); ++i)
+            sorted[i] = numbers[order[i]];
+        return sorted;
+    };
+
+    auto order1 = sorted_order(numbers1);
+    auto order2 = sorted_order(numbers2);
+    auto sorted1 = sorted_numbers(numbers1, order1);
+    auto sorted2 = sorted_numbers(numbers2, order2);
+
+    size_t i = 0, j = 0;
+    while (i < sorted1.size() and j < sorted2.size())
+    {
+        int number = sorted1[i];
+
+        if (number < sorted2[j])
+        {
+            ++i;
+        }
+        else if (number > sorted2[j])
+        {
+            ++j;
+        }
+        else
+        {
+            int counterpart = order2[j];
+            for (; i < sorted1.size() and sorted1[i] == number; ++i)
+                matching.first_to_second[order1[i]] = counterpart;
+            for (; j < sorted2.size() and sorted2[j] == number; ++j)
+                matching.second_matched[order2[j]] = true;
+        }
+    }
+
+    return matching;
+}
+
+static
+uint64_t hash_name(const string & name)
+{
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : name)
+    {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static
+Matching match_names(const vector<const string*> & names1, const vector<const string*> & names2)
+{
+    Matching matching(names1.size(), names2.size());
+
+    if (names1.size() == names2.size())
+    {
+        size_t i = 0;
+        while (i < names1.size() and *names1[i] == *names2[i])
+            ++i;
+
+        if (i == names1.size())
+        {
+            iota(matching.first_to_second.begin(), matching.first_to_second.end(), 0);
+            matching.second_matched.assign(names2.size(), true);
+            return matching;
+        }
+    }
+
+    // Tag 0 marks an empty slot.
+
+    size_t capacity = 16;
+    while (capacity < names2.size() * 2)
+        capacity *= 2;
+    size_t mask = capacity - 1;
+
+    vector<uint32_t> tags(capacity, 0);
+    vector<int> indexes(capacity, -1);
+
+    auto tag_of = [](uint64_t hash) { return uint32_t(hash >> 32) | 1; };
+
+    for (size_t j = 0; j < names2.size(); ++j)
+    {
+        uint64_t hash = hash_name(*names2[j]);
+        uint32_t tag = tag_of(hash);
+        size_t slot = hash & mask;
+
+        while (tags[slot] and !(tags[slot] == tag and *names2[indexes[slot]] == *names2[j]))
+            slot = (slot + 1) & mask;
+
+        if (!tags[slot])
+        {
+            tags[slot] = tag;
+            indexes[slot] = int(j);
+        }
+    }
+
+    for (size_t i = 0; i < names1.size(); ++i)
+    {
+        uint64_t hash = hash_name(*names1[i]);
+        uint32_t tag = tag_of(hash);
+        size_t slot = hash & mask;
+
+        for (; tags[slot]; slot = (slot + 1) & mask)
+        {
+            if (tags[slot] == tag and *names2[indexes[slot]] == *names1[i])
+            {
+                matching.first_to_second[i] = indexes[slot];
+                matching.second_matched[indexes[slot]] = true;
+                break;
+            }
+        }
+    }
+
+    return matching;
+}
+
+Matching match_fields_by_number(const Descriptor * desc1, const Descriptor * desc2)
+{
+    vector<int> numbers1(desc1->field_count());
+    for (int i = 0; i < desc1->field_count(); ++i)
+        numbers1[i] = desc1->field(i)->number();
+
+    vector<int> numbers2(desc2->field_count());
+    for (int i = 0; i < desc2->field_count(); ++i)
+        numbers2[i] = desc2->field(i)->number();
+
+    return merge_join(numbers1, numbers2);
+}
+
+Matching match_fields_by_name(const Descriptor * desc1, const Descriptor * desc2)
+{
+    vector<const string*> names1(desc1->field_count());
+    for (int i = 0; i < desc1->field_count(); ++i)
+        names1[i] = &desc1->field(i)->name();
+
+    vector<const string*> names2(desc2->field_count());
+    for (int i = 0; i < desc2->field_count(); ++i)
+        names2[i] = &desc2->field(i)->name();
+
+    return match_names(names1, names2);
+}
+
+// Sorted character bigrams of a name, ignoring case.
+static
+vector<uint16_t> name_bigrams(const string & name)
+{
+    vector<uint16_t> result;
+    for (size_t i = 1; i < name.size(); ++i)
+    {
+        result.push_back(uint16_t(tolower((unsigned char) name[i-1])) << 8 |
+                         uint16_t(tolower((unsigned char) name[i])));
+    }
+    sort(result.begin(), result.end());
+    return result;
+}
+
+double name_similarity(const string & name1, const string & name2)
+{
+    if (name1 == name2)
+        return 1;
+
+    auto bigrams1 = name_bigrams(name1);
+    auto bigrams2 = name_bigrams(name2);
+
+    if (bigrams1.empty() or bigrams2.empty())
+        return 0;
+
+    size_t common = 0;
+    auto a = bigrams1.begin();
+    auto b = bigrams2.begin();
+    while (a != bigrams1.end() and b != bigrams2.end())
+    {
+        if (*a < *b)
+            ++a;
+        else if (*b < *a)
+            ++b;
+        else
+        {
+            ++common;
+            ++a;
+            ++b;
+        }
+    }
+
+    return 2.0 * common / (bigrams1.size() + bigrams2.size());
+}
+
+size_t pair_renamed_fields(const Descriptor * desc1, const Descriptor * desc2,
+                           Matching & matching, double min_similarity)
+{
+    // Unmatched fields of the second message by type and bigram of the name.
+    // Names need a common bigram to be similar at all.
+    unordered_map<uint32_t, vector<int>> candidates;
+
+    for (int j = 0; j < desc2->field_count(); ++j)
+    {
+        if (matching.second_matched[j])
+            continue;
+
+        auto bigrams = name_bigrams(desc2->field(j)->name());
+        bigrams.erase(unique(bigrams.begin(), bigrams.end()), bigrams.end());
+        for (uint16_t bigram : bigrams)
+            candidates[uint32_t(desc2->field(j)->type()) << 16 | bigram].push_back(j);
+    }
+
+    if (candidates.empty())
+        return 0;
+
+    struct Pair
+    {
+        double similarity;
+        bool same_number;
+        int i;
+        int j;
+    };
+
+    vector<Pair> pairs;
+    size_t scored = 0;
+    vector<int> seen(desc2->field_count(), -1);
+
+    for (int i = 0; i < desc1->field_count(); ++i)
+    {
+        if (matching.first_to_second[i] >= 0)
+            continue;
+
+        auto * field1 = desc1->field(i);
+
+        for (uint16_t bigram : name_bigrams(field1->name()))
+        {
+            auto bucket = candidates.find(uint32_t(field1->type()) << 16 | bigram);
+            if (bucket == candidates.end() or bucket->second.size() > max_rename_bucket_size)
+                continue;
+
+            for (int j : bucket->second)
+            {
+                if (seen[j] == i)
+                    continue;
+                seen[j] = i;
+
+                auto * field2 = desc2->field(j);
+                double similarity = name_similarity(field1->name(), field2->name());
+                ++scored;
+                if (similarity >= min_similarity)
+                    pairs.push_back({ similarity, field1->number() == field2->number(), i, j });
+            }
+        }
+    }
+
+    // The most similar names pair up first; of equally similar ones,
+    // those which kept their number.
+    sort(pairs.begin(), pairs.end(), [](const Pair & a, const Pair & b)
+    {
+        if (a.similarity != b.similarity)
+            return a.similarity > b.similarity;
+        if (a.same_number != b.same_number)
+            return a.same_number;
+        return make_pair(a.i, a.j) < make_pair(b.i, b.j);
+    });
+
+    for (auto & pair : pairs)
+    {
+        if (matching.first_to_second[pair.i] >= 0 or matching.second_matched[pair.j])
+            continue;
+
+        matching.first_to_second[pair.i] = pair.j;
+        matching.second_matched[pair.j] = true;
+    }
+
+    return scored;
+}
+
+// Enums with fewer values are cheaper to merge-join than to set up bitmaps for.
+static const int dense_min_value_count = 64;
+
+// Bitmaps are used when they have at most this many bits per value.
+static const int64_t dense_max_bits_per_value = 64;
+
+static
+bool dense_number_range(const EnumDescriptor * enum1, const EnumDescriptor * enum2,
+                        int64_t * min_number, int64_t * span)
+{
+    int count = enum1->value_count() + enum2->value_count();
+    if (count < dense_min_value_count)
+        return false;
+
+    int64_t lowest = INT64_MAX;
+    int64_t highest = INT64_MIN;
+
+    for (auto * e : { enum1, enum2 })
+    {
+        for (int i = 0; i < e->value_count(); ++i)
+        {
+            lowest = min<int64_t>(lowest, e->value(i)->number());
+            highest = max<int64_t>(highest, e->value(i)->number());
+        }
+    }
+
+    *min_number = lowest;
+    *span = highest - lowest + 1;
+
+    return *span <= dense_max_bits_per_value * count;
+}
+
+static
+vector<uint64_t> presence_bitmap(const EnumDescriptor * e, int64_t min_number, int64_t span)
+{
+    vector<uint64_t> bitmap((span + 63) / 64, 0);
+    for (int i = 0; i < e->value_count(); ++i)
+    {
+        uint64_t bit = e->value(i)->number() - min_number;
+        bitmap[bit / 64] |= uint64_t(1) << (bit % 64);
+    }
+    return bitmap;
+}
+
+static
+bool test_bit(const vector<uint64_t> & bitmap, uint64_t bit)
+{
+    return bitmap[bit / 64] & (uint64_t(1) << (bit % 64));
+}
+
+Matching match_values_by_number(const EnumDescriptor * enum1, const EnumDescriptor * enum2)
+{
+    int64_t min_number, span;
+
+    if (!dense_number_range(enum1, enum2, &min_number, &span))
+    {
+        vector<int> numbers1(enum1->value_count());
+        for (int i = 0; i < enum1->value_count(); ++i)
+            numbers1[i] = enum1->value(i)->number();
+
+        vector<int> numbers2(enum2->value_count());
+        for (int i = 0; i < enum2->value_count(); ++i)
+            numbers2[i] = enum2->value(i)->number();
+
+        return merge_join(numbers1, numbers2);
+    }
+
+    auto removed = presence_bitmap(enum1, min_number, span);
+    auto added = presence_bitmap(enum2, min_number, span);
+
+    // removed = present1 & ~present2, added = present2 & ~present1.
+    // Plain loops over whole words, which the compiler vectorizes.
+    size_t word_count = removed.size();
+    uint64_t * r = removed.data();
+    uint64_t * a = added.data();
+    for (size_t i = 0; i < word_count; ++i)
+    {
+        uint64_t present1 = r[i];
+        uint64_t present2 = a[i];
+        r[i] = present1 & ~present2;
+        a[i] = present2 & ~present1;
+    }
+
+    Matching matching(enum1->value_count(), enum2->value_count());
+
+    for (int i = 0; i < enum1->value_count(); ++i)
+    {
+        int number = enum1->value(i)->number();
+        if (!test_bit(removed, number - min_number))
+            matching.first_to_second[i] = enum2->FindValueByNumber(number)->index();
+    }
+
+    for (int i = 0; i < enum2->value_count(); ++i)
+    {
+        matching.second_matched[i] = !test_bit(added, enum2->value(i)->number() - min_number);
+    }
+
+    return matching;
+}
+
+Matching match_values_by_name(const EnumDescriptor * enum1, const EnumDescriptor * enum2)
+{
+    vector<const string*> names1(enum1->value_count());
+    for (int i = 0; i < enum1->value_count(); ++i)
+        names1[i] = &enum1->value(i)->name();
+
+    vector<const string*> names2(enum2->value_count());
+    for (int i = 0; i < enum2->value_count(); ++i)
+        names2[i] = &enum2->value(i)->name();
+
+    return match_names(names1, names2);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <google/protobuf/descriptor.h>
+
+#include <cstddef>
+#include <vector>
+
+using std::vector;
+
+// Pairing of the elements (fields or enum values) of two types.
+struct Matching
+{
+    Matching(int count1, int count2):
+        first_to_second(count1, -1),
+        second_matched(count2, false)
+    {}
+
+    // For each element of the first type,
+    // the index of the matching element of the second type or -1.
+    vector<int> first_to_second;
+
+    // For each element of the second type, whether any element matches it.
+    vector<bool> second_matched;
+};
+
+// Fields are paired by a single merge-join over both field lists sorted by number.
+Matching match_fields_by_number(const google::protobuf::Descriptor * desc1,
+                                const google::protobuf::Descriptor * desc2);
+
+// Names are paired in one batch: when both sides list the same names in the
+// same order, the pairing is the identity. Otherwise the names of the second
+// side are hashed once into a flat open-addressing table of 32-bit tags and
+// indices, which the names of the first side are probed against.
+Matching match_fields_by_name(const google::protobuf::Descriptor * desc1,
+                              const google::protobuf::Descriptor * desc2);
+
+// Pairs unmatched fields of the first message with unmatched fields of the
+// second message that have the same type and a name similarity of at least
+// min_similarity, whether or not their number changed. Candidates are
+// bucketed by type and by each bigram of their name, and only fields sharing
+// a bucket are scored; buckets over max_rename_bucket_size (bigrams common
+// to many names) are not searched. The most similar names are paired first.
+//
+// Returns the number of name pairs scored.
+size_t pair_renamed_fields(const google::protobuf::Descriptor * desc1,
+                           const google::protobuf::Descriptor * desc2,
+                           Matching & matching, double min_similarity);
+
+const size_t max_rename_bucket_size = 32;
+
+// Dice coefficient of the character bigrams of two names, in [0, 1].
+double name_similarity(const std::string & name1, const std::string & name2);
+
+// Enums with a dense range of numbers are paired using presence bitmaps,
+// which yield the added and removed values with word-wide operations; only
+// values present on both sides are looked up individually. Sparse enums
+// fall back to a sorted merge-join.
+Matching match_values_by_number(const google::protobuf::EnumDescriptor * enum1,
+                                const google::protobuf::EnumDescriptor * enum2);
+
+Matching match_values_by_name(const google::protobuf::EnumDescriptor * enum1,
+                              const google::protobuf::EnumDescriptor * enum2);
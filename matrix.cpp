@@ -0,0 +1,102 @@
+#include "matrix.h"
+#include "digest.h"
+#include "thread_pool.h"
+
+#include <iomanip>
+#include <iostream>
+
+using namespace std;
+
+int run_matrix(const vector<pair<string, string>> & versions,
+               const vector<string> & selectors,
+               const Comparison::Options & options,
+               unsigned int thread_count)
+{
+    size_t count = versions.size();
+
+    vector<shared_ptr<Source>> sources(count);
+    vector<uint64_t> digests(count, 0);
+    vector<string> errors(count);
+
+    // With a type mapping, the same names on both sides do not pair up,
+    // so equal digests do not imply equal comparisons.
+    bool use_digests = !options.type_mapping;
+
+    vector<string> cells(count * count);
+
+    {
+        ThreadPool pool(thread_count);
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            pool.submit([&, i]
+            {
+                try
+                {
+                    sources[i] = make_shared<Source>(versions[i].second, versions[i].first);
+                    if (use_digests)
+                        digests[i] = StructuralDigest().digest(*sources[i], selectors);
+                }
+                catch (std::exception & e)
+                {
+                    errors[i] = e.what();
+                }
+            });
+        }
+
+        pool.wait();
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            for (size_t j = 0; j < count; ++j)
+            {
+                auto & cell = cells[i * count + j];
+
+                if (i == j)
+                    cell = "-";
+                else if (!sources[i] or !sources[j])
+                    cell = "!";
+                else if (use_digests and digests[i] == digests[j])
+                    cell = "=";
+                else
+                {
+                    pool.submit([&, i, j]
+                    {
+                        Comparison comparison(options);
+                        comparison.run(*sources[i], *sources[j], selectors);
+                        cells[i * count + j] = to_string(comparison.root.item_count());
+                    });
+                }
+            }
+        }
+
+        pool.wait();
+    }
+
+    int status = 0;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        cout << setw(4) << i + 1 << ": " << versions[i].first << " " << versions[i].second << '\n';
+        if (!errors[i].empty())
+        {
+            cerr << versions[i].first << " " << versions[i].second << ": " << errors[i] << endl;
+            status = 1;
+        }
+    }
+
+    cout << '\n' << setw(4) << "";
+    for (size_t j = 0; j < count; ++j)
+        cout << setw(6) << j + 1;
+    cout << '\n';
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        cout << setw(4) << i + 1;
+        for (size_t j = 0; j < count; ++j)
+            cout << setw(6) << cells[i * count + j];
+        cout << '\n';
+    }
+
+    return status;
+}
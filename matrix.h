@@ -0,0 +1,20 @@
+#pragma once
+
+#include "comparison.h"
+
+#include <utility>
+#include <vector>
+
+// Compares every ordered pair of versions from a list of (root directory,
+// file) versions and prints a compatibility matrix: row i, column j holds
+// the number of differences reported when comparing version i to version j.
+//
+// Each version is loaded once. Pairs whose selected types have equal
+// structural digests are marked identical without being compared. Loading
+// and comparisons run on a pool of thread_count threads (0 for one per core).
+//
+// Returns 0 on success, 1 if any version failed to load.
+int run_matrix(const vector<std::pair<string, string>> & versions,
+               const vector<string> & selectors,
+               const Comparison::Options & options,
+               unsigned int thread_count);
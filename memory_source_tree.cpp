@@ -0,0 +1,50 @@
+#include "memory_source_tree.h"
+
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+
+using namespace std;
+
+using google::protobuf::io::ArrayInputStream;
+using google::protobuf::io::ZeroCopyInputStream;
+
+namespace {
+
+// Size of the blocks handed to the parser, so that it can be stopped
+// between blocks without copying.
+const int stream_block_size = 64 * 1024;
+
+}
+
+MemorySourceTree::MemorySourceTree(map<string, string> files):
+    files(std::move(files))
+{}
+
+MemorySourceTree::MemorySourceTree(Provider provider):
+    provider(std::move(provider))
+{}
+
+ZeroCopyInputStream * MemorySourceTree::Open(const string & filename)
+{
+    string_view content;
+
+    if (provider)
+    {
+        if (!provider(filename, &content))
+        {
+            last_error = "File not found.";
+            return nullptr;
+        }
+    }
+    else
+    {
+        auto file = files.find(filename);
+        if (file == files.end())
+        {
+            last_error = "File not found.";
+            return nullptr;
+        }
+        content = file->second;
+    }
+
+    return new ArrayInputStream(content.data(), content.size(), stream_block_size);
+}
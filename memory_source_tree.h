@@ -0,0 +1,32 @@
+#pragma once
+
+#include <google/protobuf/compiler/importer.h>
+
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+
+// Files held in memory, for embedding without file system access.
+// Contents are handed to the parser without copying.
+
+class MemorySourceTree : public google::protobuf::compiler::SourceTree
+{
+public:
+    // Sets content to the file at path and returns true, or returns false
+    // if there is no such file. The content must stay valid as long as
+    // the tree is in use.
+    using Provider = std::function<bool(const std::string & path, std::string_view * content)>;
+
+    // Path -> content.
+    MemorySourceTree(std::map<std::string, std::string> files);
+    MemorySourceTree(Provider provider);
+
+    google::protobuf::io::ZeroCopyInputStream * Open(const std::string & filename) override;
+    std::string GetLastErrorMessage() override { return last_error; }
+
+private:
+    std::map<std::string, std::string> files;
+    Provider provider;
+    std::string last_error;
+};
@@ -0,0 +1,302 @@
+#include "moves.h"
+#include "type_mapping.h"
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <tuple>
+#include <unordered_set>
+
+using namespace std;
+
+using google::protobuf::Descriptor;
+using google::protobuf::EnumDescriptor;
+using google::protobuf::FieldDescriptor;
+using google::protobuf::FileDescriptor;
+
+static
+uint64_t mix(uint64_t x)
+{
+    // splitmix64 finalizer
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return x;
+}
+
+static
+uint64_t hash_string(const string & s, uint64_t seed)
+{
+    uint64_t hash = 14695981039346656037ull ^ seed;
+    for (unsigned char c : s)
+    {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static
+TypeSignature min_hash(const vector<uint64_t> & features)
+{
+    TypeSignature signature;
+    signature.hashes.assign(TypeSignature::size, UINT32_MAX);
+
+    for (uint64_t feature : features)
+    {
+        for (int k = 0; k < TypeSignature::size; ++k)
+        {
+            uint32_t hash = uint32_t(mix(feature + 0x9e3779b97f4a7c15ull * (k + 1)));
+            signature.hashes[k] = min(signature.hashes[k], hash);
+        }
+    }
+
+    return signature;
+}
+
+TypeSignature type_signature(const Descriptor * desc)
+{
+    vector<uint64_t> features;
+    features.push_back(hash_string(desc->name(), 1));
+
+    for (int i = 0; i < desc->field_count(); ++i)
+    {
+        auto * field = desc->field(i);
+        features.push_back(mix(uint64_t(field->number()) << 16 | field->type() << 8 | field->label()));
+        features.push_back(hash_string(field->name(), 2));
+
+        if (field->message_type())
+            features.push_back(hash_string(field->message_type()->name(), 3));
+        else if (field->enum_type())
+            features.push_back(hash_string(field->enum_type()->name(), 3));
+    }
+
+    return min_hash(features);
+}
+
+TypeSignature type_signature(const EnumDescriptor * desc)
+{
+    vector<uint64_t> features;
+    features.push_back(hash_string(desc->name(), 1));
+
+    for (int i = 0; i < desc->value_count(); ++i)
+    {
+        auto * value = desc->value(i);
+        features.push_back(mix(uint64_t(uint32_t(value->number()))));
+        features.push_back(hash_string(value->name(), uint64_t(uint32_t(value->number())) << 8 | 2));
+    }
+
+    return min_hash(features);
+}
+
+double signature_similarity(const TypeSignature & a, const TypeSignature & b)
+{
+    int equal = 0;
+    for (int k = 0; k < TypeSignature::size; ++k)
+        equal += a.hashes[k] == b.hashes[k];
+    return double(equal) / TypeSignature::size;
+}
+
+template <typename T>
+static
+void pair_by_signature(const vector<const T*> & types1, const vector<const T*> & types2,
+                       double min_similarity, unordered_map<const T*, const T*> & pairs)
+{
+    if (types1.empty() or types2.empty())
+        return;
+
+    vector<TypeSignature> signatures1, signatures2;
+    for (auto * type : types1)
+        signatures1.push_back(type_signature(type));
+    for (auto * type : types2)
+        signatures2.push_back(type_signature(type));
+
+    vector<bool> paired1(types1.size(), false);
+    vector<bool> paired2(types2.size(), false);
+
+    // Types with identical signatures (e.g. empty messages of the same name)
+    // would all share every bucket. They are paired first, by full name.
+
+    map<vector<uint32_t>, pair<vector<int>, vector<int>>> identical;
+    for (int i = 0; i < int(signatures1.size()); ++i)
+        identical[signatures1[i].hashes].first.push_back(i);
+    for (int j = 0; j < int(signatures2.size()); ++j)
+        identical[signatures2[j].hashes].second.push_back(j);
+
+    for (auto & group : identical)
+    {
+        auto & indices1 = group.second.first;
+        auto & indices2 = group.second.second;
+        if (indices1.empty() or indices2.empty())
+            continue;
+
+        sort(indices1.begin(), indices1.end(), [&](int a, int b)
+             { return types1[a]->full_name() < types1[b]->full_name(); });
+        sort(indices2.begin(), indices2.end(), [&](int a, int b)
+             { return types2[a]->full_name() < types2[b]->full_name(); });
+
+        for (size_t k = 0; k < min(indices1.size(), indices2.size()); ++k)
+        {
+            paired1[indices1[k]] = paired2[indices2[k]] = true;
+            pairs.emplace(types1[indices1[k]], types2[indices2[k]]);
+        }
+    }
+
+    const int band_count = TypeSignature::size / TypeSignature::band_size;
+
+    auto band_key = [](const TypeSignature & signature, int band)
+    {
+        uint64_t key = band;
+        for (int r = 0; r < TypeSignature::band_size; ++r)
+            key = mix(key ^ signature.hashes[band * TypeSignature::band_size + r]);
+        return key;
+    };
+
+    unordered_map<uint64_t, vector<int>> buckets;
+    for (int j = 0; j < int(signatures2.size()); ++j)
+    {
+        if (paired2[j])
+            continue;
+        for (int band = 0; band < band_count; ++band)
+            buckets[band_key(signatures2[j], band)].push_back(j);
+    }
+
+    vector<tuple<double, int, int>> candidates;
+    unordered_set<int> seen;
+
+    for (int i = 0; i < int(signatures1.size()); ++i)
+    {
+        if (paired1[i])
+            continue;
+
+        seen.clear();
+        for (int band = 0; band < band_count; ++band)
+        {
+            auto bucket = buckets.find(band_key(signatures1[i], band));
+            if (bucket == buckets.end() or bucket->second.size() > TypeSignature::max_bucket_size)
+                continue;
+
+            for (int j : bucket->second)
+            {
+                if (!seen.insert(j).second)
+                    continue;
+
+                double similarity = signature_similarity(signatures1[i], signatures2[j]);
+                if (similarity >= min_similarity)
+                    candidates.emplace_back(-similarity, i, j);
+            }
+        }
+    }
+
+    // Best pairs first; ties in declaration order.
+    sort(candidates.begin(), candidates.end());
+
+    for (auto & candidate : candidates)
+    {
+        int i = get<1>(candidate);
+        int j = get<2>(candidate);
+        if (paired1[i] or paired2[j])
+            continue;
+        paired1[i] = paired2[j] = true;
+        pairs.emplace(types1[i], types2[j]);
+    }
+}
+
+TypeMoves find_moved_types(const FileDescriptor * file1, const FileDescriptor * file2,
+                           double min_similarity, const TypeMapping * mapping)
+{
+    TypeMoves moves;
+
+    auto * pool1 = file1->pool();
+    auto * pool2 = file2->pool();
+
+    // Counterparts of types of file1, by the mapping or by name.
+    unordered_set<const void*> matched;
+    string name2;
+
+    vector<const Descriptor*> removed_messages;
+    vector<const EnumDescriptor*> removed_enums;
+
+    for (int i = 0; i < file1->message_type_count(); ++i)
+    {
+        auto * msg1 = file1->message_type(i);
+        auto * matched2 = mapping and mapping->map(msg1->full_name(), name2) ?
+                    pool2->FindMessageTypeByName(name2) :
+                    file2->FindMessageTypeByName(msg1->name());
+        if (matched2)
+        {
+            matched.insert(matched2);
+            continue;
+        }
+
+        auto * msg2 = pool2->FindMessageTypeByName(msg1->full_name());
+        if (msg2)
+            moves.messages.emplace(msg1, msg2);
+        else
+            removed_messages.push_back(msg1);
+    }
+
+    for (int i = 0; i < file1->enum_type_count(); ++i)
+    {
+        auto * enum1 = file1->enum_type(i);
+        auto * matched2 = mapping and mapping->map(enum1->full_name(), name2) ?
+                    pool2->FindEnumTypeByName(name2) :
+                    file2->FindEnumTypeByName(enum1->name());
+        if (matched2)
+        {
+            matched.insert(matched2);
+            continue;
+        }
+
+        auto * enum2 = pool2->FindEnumTypeByName(enum1->full_name());
+        if (enum2)
+            moves.enums.emplace(enum1, enum2);
+        else
+            removed_enums.push_back(enum1);
+    }
+
+    if (removed_messages.empty() and removed_enums.empty())
+        return moves;
+
+    // Candidates: unmatched types of file2 and types of its imports
+    // which are new in the second pool.
+
+    vector<const Descriptor*> added_messages;
+    vector<const EnumDescriptor*> added_enums;
+
+    unordered_set<const FileDescriptor*> visited { file2 };
+    vector<const FileDescriptor*> files { file2 };
+
+    while (!files.empty())
+    {
+        auto * file = files.back();
+        files.pop_back();
+
+        for (int i = 0; i < file->dependency_count(); ++i)
+        {
+            if (visited.insert(file->dependency(i)).second)
+                files.push_back(file->dependency(i));
+        }
+
+        for (int i = 0; i < file->message_type_count(); ++i)
+        {
+            auto * msg2 = file->message_type(i);
+            if (!matched.count(msg2) and (file == file2 or !pool1->FindMessageTypeByName(msg2->full_name())))
+                added_messages.push_back(msg2);
+        }
+
+        for (int i = 0; i < file->enum_type_count(); ++i)
+        {
+            auto * enum2 = file->enum_type(i);
+            if (!matched.count(enum2) and (file == file2 or !pool1->FindEnumTypeByName(enum2->full_name())))
+                added_enums.push_back(enum2);
+        }
+    }
+
+    pair_by_signature(removed_messages, added_messages, min_similarity, moves.messages);
+    pair_by_signature(removed_enums, added_enums, min_similarity, moves.enums);
+
+    return moves;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <google/protobuf/descriptor.h>
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+using std::unordered_map;
+using std::vector;
+
+class TypeMapping;
+
+// Pairs top-level types of file1 that have no counterpart of the same name in
+// file2 with types defined elsewhere on the second side: unmatched types of
+// file2, or types of the files it imports that do not exist in the first pool.
+//
+// A type that kept its full name but moved to an imported file is paired
+// directly. The rest are paired by structure: each type gets a MinHash
+// signature over a set of features of its fields or values, signatures are
+// bucketed by locality-sensitive hashing (banding), and only types sharing a
+// bucket are considered. Each type is paired at most once, greedily by the
+// estimated similarity. Types with identical signatures are paired first, in
+// order of full names, and buckets over max_bucket_size are not searched.
+//
+// Types that mapping pairs with a type of file2 are neither paired
+// nor candidates.
+
+struct TypeMoves
+{
+    unordered_map<const google::protobuf::Descriptor*, const google::protobuf::Descriptor*> messages;
+    unordered_map<const google::protobuf::EnumDescriptor*, const google::protobuf::EnumDescriptor*> enums;
+};
+
+TypeMoves find_moved_types(const google::protobuf::FileDescriptor * file1,
+                           const google::protobuf::FileDescriptor * file2,
+                           double min_similarity,
+                           const TypeMapping * mapping = nullptr);
+
+struct TypeSignature
+{
+    static const int size = 64;
+    static const int band_size = 4;
+    static const size_t max_bucket_size = 64;
+
+    vector<uint32_t> hashes;
+};
+
+TypeSignature type_signature(const google::protobuf::Descriptor * desc);
+TypeSignature type_signature(const google::protobuf::EnumDescriptor * desc);
+
+// Estimated Jaccard similarity of the feature sets of two types.
+double signature_similarity(const TypeSignature & a, const TypeSignature & b);
@@ -0,0 +1,118 @@
+#include "parse_cache.h"
+
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+
+using namespace std;
+
+using google::protobuf::FileDescriptorProto;
+using google::protobuf::compiler::MultiFileErrorCollector;
+using google::protobuf::io::ArrayInputStream;
+using google::protobuf::io::ZeroCopyInputStream;
+using google::protobuf::compiler::SourceTree;
+using google::protobuf::compiler::SourceTreeDescriptorDatabase;
+
+namespace {
+
+// Serves a single file whose content was already read.
+class SingleFileSourceTree : public SourceTree
+{
+public:
+    SingleFileSourceTree(const string & path, const string & content):
+        path(path), content(content)
+    {}
+
+    ZeroCopyInputStream * Open(const string & filename) override
+    {
+        if (filename != path)
+            return nullptr;
+        return new ArrayInputStream(content.data(), content.size());
+    }
+
+private:
+    const string & path;
+    const string & content;
+};
+
+}
+
+shared_ptr<FileDescriptorProto> parse_file(const string & filename, const string & content,
+                                           MultiFileErrorCollector * errors)
+{
+    SingleFileSourceTree single_file(filename, content);
+    SourceTreeDescriptorDatabase parser(&single_file);
+    parser.RecordErrorsTo(errors);
+
+    auto parsed = make_shared<FileDescriptorProto>();
+    if (!parser.FindFileByName(filename, parsed.get()))
+        return nullptr;
+
+    return parsed;
+}
+
+shared_ptr<const ParseCache::FileDescriptorProto> ParseCache::find(const string & path, const string & blob_id)
+{
+    lock_guard<std::mutex> lock(mutex);
+
+    auto cached = files.find(Key(path, blob_id));
+    if (cached == files.end())
+        return nullptr;
+    return cached->second;
+}
+
+void ParseCache::insert(const string & path, const string & blob_id,
+                        shared_ptr<const FileDescriptorProto> file)
+{
+    lock_guard<std::mutex> lock(mutex);
+    files.emplace(Key(path, blob_id), file);
+}
+
+size_t ParseCache::size()
+{
+    lock_guard<std::mutex> lock(mutex);
+    return files.size();
+}
+
+GitDescriptorDatabase::GitDescriptorDatabase(shared_ptr<GitSourceTree> tree, shared_ptr<ParseCache> cache,
+                                             MultiFileErrorCollector * errors):
+    tree(tree),
+    cache(cache),
+    errors(errors)
+{}
+
+bool GitDescriptorDatabase::FindFileByName(const string & filename, FileDescriptorProto * output)
+{
+    // The content is only fetched if the version is not cached.
+    string id = tree->blob_id(filename);
+
+    if (id.empty())
+    {
+        if (errors)
+            errors->AddError(filename, -1, 0, "File not found.");
+        return false;
+    }
+
+    auto file = cache->find(filename, id);
+
+    if (!file)
+    {
+        string content;
+        if (!tree->read(filename, &content, nullptr))
+        {
+            if (errors)
+                errors->AddError(filename, -1, 0, "File not found.");
+            return false;
+        }
+
+        auto parsed = parse_file(filename, content, errors);
+        if (!parsed)
+            return false;
+
+        cache->insert(filename, id, parsed);
+        file = parsed;
+    }
+
+    d_files[filename] = id;
+    *output = *file;
+
+    return true;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "git_source_tree.h"
+
+#include <google/protobuf/compiler/importer.h>
+#include <google/protobuf/descriptor.pb.h>
+#include <google/protobuf/descriptor_database.h>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// Parses a file whose content was already read, without its imports.
+// Returns nullptr on failure; errors go to errors, if given.
+std::shared_ptr<google::protobuf::FileDescriptorProto> parse_file(
+        const std::string & filename, const std::string & content,
+        google::protobuf::compiler::MultiFileErrorCollector * errors);
+
+// Parsed files keyed by (path, blob id), so that a file version which
+// appears in many revisions is parsed only once.
+// Safe to use from multiple threads.
+
+class ParseCache
+{
+public:
+    using FileDescriptorProto = google::protobuf::FileDescriptorProto;
+
+    // Returns nullptr if the file version is not cached.
+    std::shared_ptr<const FileDescriptorProto> find(const std::string & path, const std::string & blob_id);
+
+    void insert(const std::string & path, const std::string & blob_id,
+                std::shared_ptr<const FileDescriptorProto> file);
+
+    // Number of parsed file versions.
+    size_t size();
+
+private:
+    using Key = std::pair<std::string, std::string>;
+
+    std::mutex mutex;
+    std::map<Key, std::shared_ptr<const FileDescriptorProto>> files;
+};
+
+// Descriptor database over the files of a git revision.
+// Files are looked up in a shared ParseCache by blob id, and only read
+// and parsed on a miss.
+//
+// Records the blob id of every file it provided. Two revisions which
+// provided the same files for the same request have identical inputs.
+
+class GitDescriptorDatabase : public google::protobuf::DescriptorDatabase
+{
+public:
+    using FileDescriptorProto = google::protobuf::FileDescriptorProto;
+    using MultiFileErrorCollector = google::protobuf::compiler::MultiFileErrorCollector;
+
+    GitDescriptorDatabase(std::shared_ptr<GitSourceTree> tree, std::shared_ptr<ParseCache> cache,
+                          MultiFileErrorCollector * errors = nullptr);
+
+    bool FindFileByName(const std::string & filename, FileDescriptorProto * output) override;
+
+    // Files are only found by name; symbols are resolved by the pool.
+    bool FindFileContainingSymbol(const std::string &, FileDescriptorProto *) override { return false; }
+    bool FindFileContainingExtension(const std::string &, int, FileDescriptorProto *) override { return false; }
+
+    // Path -> blob id of each file provided so far.
+    const std::map<std::string, std::string> & files() const { return d_files; }
+
+private:
+    std::shared_ptr<GitSourceTree> tree;
+    std::shared_ptr<ParseCache> cache;
+    MultiFileErrorCollector * errors;
+    std::map<std::string, std::string> d_files;
+};
@@ -0,0 +1,40 @@
+#include "source_cache.h"
+
+using namespace std;
+
+shared_ptr<Source> SourceCache::get(const string & root_dir, const string & file_path)
+{
+    promise<shared_ptr<Source>> loading;
+    shared_future<shared_ptr<Source>> source;
+    bool load = false;
+
+    {
+        lock_guard<std::mutex> lock(mutex);
+
+        auto cached = sources.find(Key(root_dir, file_path));
+        if (cached != sources.end())
+        {
+            source = cached->second;
+        }
+        else
+        {
+            source = loading.get_future().share();
+            sources.emplace(Key(root_dir, file_path), source);
+            load = true;
+        }
+    }
+
+    if (load)
+    {
+        try
+        {
+            loading.set_value(make_shared<Source>(file_path, root_dir));
+        }
+        catch (...)
+        {
+            loading.set_exception(current_exception());
+        }
+    }
+
+    return source.get();
+}
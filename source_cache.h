@@ -0,0 +1,23 @@
+#pragma once
+
+#include "comparison.h"
+
+#include <future>
+#include <map>
+#include <mutex>
+
+// Loads each (root directory, file) Source once and shares it between users.
+// Safe to use from multiple threads; different Sources load concurrently.
+
+class SourceCache
+{
+public:
+    // Throws the loading error of the Source, to every caller.
+    shared_ptr<Source> get(const string & root_dir, const string & file_path);
+
+private:
+    using Key = std::pair<string, string>;
+
+    std::mutex mutex;
+    std::map<Key, std::shared_future<shared_ptr<Source>>> sources;
+};
@@ -0,0 +1,141 @@
+#include "source_tree.h"
+#include "archive_source_tree.h"
+#include "git_source_tree.h"
+#include "mapped_source_tree.h"
+
+#include <stdexcept>
+
+using namespace std;
+
+using google::protobuf::compiler::SourceTree;
+using google::protobuf::io::ZeroCopyInputStream;
+
+namespace {
+
+class StoppableInputStream : public ZeroCopyInputStream
+{
+public:
+    StoppableInputStream(ZeroCopyInputStream * stream, const string & filename,
+                         const function<bool(const string &)> & stop):
+        stream(stream), filename(filename), stop(stop)
+    {}
+
+    bool Next(const void ** data, int * size) override
+    {
+        if (stop(filename))
+            return false;
+        return stream->Next(data, size);
+    }
+
+    void BackUp(int count) override { stream->BackUp(count); }
+    bool Skip(int count) override { return stream->Skip(count); }
+    int64_t ByteCount() const override { return stream->ByteCount(); }
+
+private:
+    unique_ptr<ZeroCopyInputStream> stream;
+    string filename;
+    const function<bool(const string &)> & stop;
+};
+
+}
+
+shared_ptr<SourceTree> open_source_tree(const string & root)
+{
+    if (root.compare(0, 4, "git:") == 0)
+    {
+        string revision = root.substr(4);
+        string dir;
+
+        auto separator = revision.find(':');
+        if (separator != string::npos)
+        {
+            dir = revision.substr(separator + 1);
+            revision.resize(separator);
+        }
+
+        return make_shared<GitSourceTree>(GitRepository::open("."), revision, dir);
+    }
+
+    if (ArchiveSourceTree::is_archive(root))
+        return make_shared<ArchiveSourceTree>(root);
+
+    auto separator = root.rfind(':');
+    if (separator != string::npos and ArchiveSourceTree::is_archive(root.substr(0, separator)))
+        return make_shared<ArchiveSourceTree>(root.substr(0, separator), root.substr(separator + 1));
+
+    return make_shared<MappedSourceTree>(root);
+}
+
+shared_ptr<SourceTree> open_source_tree(const vector<string> & roots)
+{
+    if (roots.empty())
+        throw std::runtime_error("No source root given.");
+
+    if (roots.size() == 1)
+        return open_source_tree(roots.front());
+
+    vector<shared_ptr<SourceTree>> trees;
+    for (auto & root : roots)
+        trees.push_back(open_source_tree(root));
+
+    return make_shared<MultiSourceTree>(std::move(trees));
+}
+
+MultiSourceTree::MultiSourceTree(vector<shared_ptr<SourceTree>> trees):
+    trees(std::move(trees))
+{}
+
+ZeroCopyInputStream * MultiSourceTree::Open(const string & filename)
+{
+    auto cached = resolved.find(filename);
+    if (cached != resolved.end())
+    {
+        if (cached->second < 0)
+        {
+            last_error = missing.at(filename);
+            return nullptr;
+        }
+
+        auto * stream = trees[cached->second]->Open(filename);
+        if (stream)
+            return stream;
+
+        resolved.erase(cached);
+    }
+
+    // A specific reason, such as an invalid path, is kept over not-found.
+    string error = "File not found.";
+
+    for (size_t i = 0; i < trees.size(); ++i)
+    {
+        auto * stream = trees[i]->Open(filename);
+        if (stream)
+        {
+            resolved[filename] = int(i);
+            missing.erase(filename);
+            return stream;
+        }
+
+        string tree_error = trees[i]->GetLastErrorMessage();
+        if (!tree_error.empty() and tree_error != "File not found.")
+            error = tree_error;
+    }
+
+    resolved[filename] = -1;
+    missing[filename] = error;
+    last_error = error;
+    return nullptr;
+}
+
+StoppableSourceTree::StoppableSourceTree(shared_ptr<SourceTree> tree, function<bool(const string &)> stop):
+    tree(tree),
+    stop(std::move(stop))
+{}
+
+ZeroCopyInputStream * StoppableSourceTree::Open(const string & filename)
+{
+    auto * stream = tree->Open(filename);
+    if (!stream)
+        return nullptr;
+    return new StoppableInputStream(stream, filename, stop);
+}
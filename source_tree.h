@@ -0,0 +1,63 @@
+#pragma once
+
+#include <google/protobuf/compiler/importer.h>
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Source tree for a root given on the command line:
+// - "git:REV" or "git:REV:DIR": the files at revision REV (under directory
+//   DIR) in the git repository of the working directory, see GitSourceTree,
+// - "ARCHIVE" or "ARCHIVE:DIR", where ARCHIVE ends with .tar, .tar.gz, .tgz
+//   or .zip: the files in the archive (under directory DIR),
+//   see ArchiveSourceTree,
+// - anything else: a directory on disk, see MappedSourceTree.
+std::shared_ptr<google::protobuf::compiler::SourceTree> open_source_tree(const std::string & root);
+
+// Source tree over several roots, searched in order like protoc -I paths.
+// Throws std::runtime_error if roots is empty.
+std::shared_ptr<google::protobuf::compiler::SourceTree> open_source_tree(const std::vector<std::string> & roots);
+
+// Files from the first of several trees that has them.
+// The tree serving each path is remembered, and so are missing paths with
+// the most specific error message of the trees, e.g. for an invalid path.
+
+class MultiSourceTree : public google::protobuf::compiler::SourceTree
+{
+public:
+    using SourceTree = google::protobuf::compiler::SourceTree;
+
+    MultiSourceTree(std::vector<std::shared_ptr<SourceTree>> trees);
+
+    google::protobuf::io::ZeroCopyInputStream * Open(const std::string & filename) override;
+    std::string GetLastErrorMessage() override { return last_error; }
+
+private:
+    std::vector<std::shared_ptr<SourceTree>> trees;
+    // Path -> index of the tree which has it, or -1 if none has it.
+    std::map<std::string, int> resolved;
+    // Missing path -> error message.
+    std::map<std::string, std::string> missing;
+    std::string last_error;
+};
+
+// Files of another tree, which end early once stop(filename) returns true,
+// so that the parser does not read on past the point of interest.
+
+class StoppableSourceTree : public google::protobuf::compiler::SourceTree
+{
+public:
+    using SourceTree = google::protobuf::compiler::SourceTree;
+
+    StoppableSourceTree(std::shared_ptr<SourceTree> tree, std::function<bool(const std::string &)> stop);
+
+    google::protobuf::io::ZeroCopyInputStream * Open(const std::string & filename) override;
+    std::string GetLastErrorMessage() override { return tree->GetLastErrorMessage(); }
+
+private:
+    std::shared_ptr<SourceTree> tree;
+    std::function<bool(const std::string &)> stop;
+};
@@ -1,8 +1,12 @@
 #include "../json/json.hpp"
 #include "../comparison.h"
+#include "../directory.h"
 
 #include <iostream>
+#include <filesystem>
 #include <fstream>
+#include <map>
+#include <sstream>
 
 using nlohmann::json;
 using namespace std;
@@ -29,6 +33,8 @@ string section_type_string(Comparison::SectionType type)
         return "enum_comparison";
     case Comparison::Enum_Value_Comparison:
         return "enum_value_comparison";
+    case Comparison::File_Comparison:
+        return "file_comparison";
     default:
         throw std::runtime_error("Unexpected section type.");
     }
@@ -68,8 +74,18 @@ string item_type_string(Comparison::ItemType type)
         return "file_enum_added";
     case Comparison::File_Enum_Removed:
         return "file_enum_removed";
+    case Comparison::File_Message_Moved:
+        return "file_message_moved";
+    case Comparison::File_Enum_Moved:
+        return "file_enum_moved";
+    case Comparison::Rpc_Payload_Affected:
+        return "rpc_payload_affected";
     case Comparison::Name_Missing:
         return "name_missing";
+    case Comparison::File_Added:
+        return "file_added";
+    case Comparison::File_Removed:
+        return "file_removed";
     default:
         throw std::runtime_error("Unexpected item type.");
     }
@@ -145,6 +161,25 @@ void verify(const Comparison & comparison, json & expected)
     verify(comparison.root, expected);
 }
 
+// Path -> content of the .proto files in dir.
+map<string, string> read_proto_files(const string & dir)
+{
+    map<string, string> files;
+
+    for (auto & entry : std::filesystem::directory_iterator(dir))
+    {
+        if (entry.path().extension() != ".proto")
+            continue;
+
+        ifstream file(entry.path());
+        stringstream content;
+        content << file.rdbuf();
+        files[entry.path().filename().string()] = content.str();
+    }
+
+    return files;
+}
+
 int main(int argc, char * argv[])
 {
     if (argc < 2)
@@ -156,6 +191,11 @@ int main(int argc, char * argv[])
     string test_path(argv[1]);
 
     Comparison::Options options;
+    vector<string> selectors;
+    bool in_memory = false;
+    bool dirs = false;
+    vector<string> roots_a;
+    vector<string> roots_b;
 
     if (argc > 2)
     {
@@ -166,6 +206,62 @@ int main(int argc, char * argv[])
             {
                 options.binary = true;
             }
+            else if (arg == "--impact")
+            {
+                options.impact = true;
+            }
+            else if (arg == "--renames")
+            {
+                options.detect_renames = true;
+            }
+            else if (arg == "--moves")
+            {
+                options.detect_moves = true;
+            }
+            else if (arg == "--changed-files" and i + 1 < argc)
+            {
+                try
+                {
+                    options.changed_files = make_shared<ChangeSet>(ChangeSet::load(argv[++i]));
+                }
+                catch (std::exception & e)
+                {
+                    cerr << e.what() << endl;
+                    return 1;
+                }
+            }
+            else if (arg == "--dirs")
+            {
+                dirs = true;
+            }
+            else if (arg == "--in-memory")
+            {
+                in_memory = true;
+            }
+            else if (arg == "--include1" and i + 1 < argc)
+            {
+                roots_a.push_back(argv[++i]);
+            }
+            else if (arg == "--include2" and i + 1 < argc)
+            {
+                roots_b.push_back(argv[++i]);
+            }
+            else if (arg == "--type" and i + 1 < argc)
+            {
+                selectors.push_back(argv[++i]);
+            }
+            else if (arg == "--map" and i + 1 < argc)
+            {
+                try
+                {
+                    options.type_mapping = make_shared<TypeMapping>(TypeMapping::load(argv[++i]));
+                }
+                catch (std::exception & e)
+                {
+                    cerr << e.what() << endl;
+                    return 1;
+                }
+            }
             else
             {
                 cerr << "Unknown option: " << arg << endl;
@@ -176,11 +272,49 @@ int main(int argc, char * argv[])
 
     Comparison comparison(options);
 
-    try
+    if (dirs)
+    {
+        try
+        {
+            if (selectors.empty())
+                selectors.push_back(".");
+
+            auto result = compare_directories(test_path + "/a", test_path + "/b", selectors, options);
+            if (!result.errors.empty())
+                throw std::runtime_error(result.errors.begin()->second);
+
+            comparison.root = std::move(result.root);
+        }
+        catch (std::exception & e)
+        {
+            cerr << "Error while comparing: " << e.what() << endl;
+            return 1;
+        }
+    }
+    else try
     {
-        Source source_a("a.proto", test_path);
-        Source source_b("b.proto", test_path);
-        comparison.compare(source_a, source_b);
+        shared_ptr<Source> source_a, source_b;
+
+        if (in_memory)
+        {
+            auto files = read_proto_files(test_path);
+            source_a = make_shared<Source>("a.proto", files);
+            source_b = make_shared<Source>("b.proto", files);
+        }
+        else
+        {
+            roots_a.insert(roots_a.begin(), test_path);
+            roots_b.insert(roots_b.begin(), test_path);
+            source_a = make_shared<Source>("a.proto", roots_a);
+            source_b = make_shared<Source>("b.proto", roots_b);
+        }
+        if (selectors.empty())
+            comparison.compare(*source_a, *source_b);
+        else
+            comparison.compare(*source_a, *source_b, selectors);
+
+        if (options.impact)
+            comparison.report_impact(*source_a, *source_b);
     }
     catch (std::exception & e)
     {
@@ -0,0 +1,1200 @@
+#include "../archive_source_tree.h"
+#include "../batch.h"
+#include "../chain.h"
+#include "../daemon.h"
+#include "../digest.h"
+#include "../git_source_tree.h"
+#include "../lru_cache.h"
+#include "../lsp.h"
+#include "../matching.h"
+#include "../mapped_source_tree.h"
+#include "../matrix.h"
+#include "../moves.h"
+#include "../timeline.h"
+#include "../watch.h"
+
+#include <poll.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <thread>
+
+using nlohmann::json;
+using namespace std;
+
+namespace fs = std::filesystem;
+
+void confirm(bool value, const string & what)
+{
+    // Not to cerr, which tests may capture.
+    if (value)
+        clog << "OK: " << what << endl;
+    else
+        throw std::runtime_error(what);
+}
+
+// Empty directory for the files of one test, removed afterwards.
+class TemporaryDirectory
+{
+public:
+    TemporaryDirectory(const string & name):
+        d_path(fs::temp_directory_path() / ("protobuf-spec-compare-" + name + "-" + to_string(getpid())))
+    {
+        fs::remove_all(d_path);
+        fs::create_directories(d_path);
+    }
+
+    ~TemporaryDirectory()
+    {
+        error_code error;
+        fs::remove_all(d_path, error);
+    }
+
+    string path(const string & relative = "") const
+    {
+        return relative.empty() ? d_path.string() : (d_path / relative).string();
+    }
+
+    // Writes the file, creating its directory.
+    string write(const string & relative, const string & content) const
+    {
+        auto file_path = d_path / relative;
+        fs::create_directories(file_path.parent_path());
+        ofstream file(file_path, ios::binary | ios::trunc);
+        file << content;
+        return file_path.string();
+    }
+
+private:
+    fs::path d_path;
+};
+
+// Runs a shell command and returns its output.
+string run(const string & command)
+{
+    FILE * pipe = popen(command.c_str(), "r");
+    if (!pipe)
+        throw runtime_error("Failed to run: " + command);
+
+    string output;
+    char buffer[4096];
+    size_t size;
+    while ((size = fread(buffer, 1, sizeof(buffer), pipe)) > 0)
+        output.append(buffer, size);
+
+    if (pclose(pipe) != 0)
+        throw runtime_error("Failed: " + command);
+
+    return output;
+}
+
+// Git repository in a temporary directory, with commits made by the test.
+class GitHistory : public TemporaryDirectory
+{
+public:
+    GitHistory(const string & name):
+        TemporaryDirectory(name)
+    {
+        // Same commits on every run.
+        for (auto variable : { "GIT_AUTHOR_NAME", "GIT_COMMITTER_NAME" })
+            setenv(variable, "Test", 1);
+        for (auto variable : { "GIT_AUTHOR_EMAIL", "GIT_COMMITTER_EMAIL" })
+            setenv(variable, "test@example.com", 1);
+        for (auto variable : { "GIT_AUTHOR_DATE", "GIT_COMMITTER_DATE" })
+            setenv(variable, "2020-01-01T00:00:00Z", 1);
+
+        git("init -q");
+    }
+
+    // Commits the files as given, and returns the commit id.
+    string commit(const map<string, string> & files, const string & message = "Change")
+    {
+        for (auto & file : files)
+            write(file.first, file.second);
+
+        git("add -A");
+        git("commit -q --allow-empty -m '" + message + "'");
+        return id("HEAD");
+    }
+
+    // Full id of an object, e.g. "HEAD:a.proto".
+    string id(const string & spec)
+    {
+        string output = git("rev-parse '" + spec + "'");
+        return output.substr(0, output.find('\n'));
+    }
+
+    string git(const string & arguments)
+    {
+        return run("git -C '" + path() + "' " + arguments);
+    }
+};
+
+// Collects what is written to cout and cerr, and runs in a directory,
+// while it exists.
+class CapturedRun
+{
+public:
+    CapturedRun(const string & dir):
+        working_dir(fs::current_path()),
+        cout_buffer(cout.rdbuf(out.rdbuf())),
+        cerr_buffer(cerr.rdbuf(log.rdbuf()))
+    {
+        fs::current_path(dir);
+    }
+
+    ~CapturedRun()
+    {
+        fs::current_path(working_dir);
+        cout.rdbuf(cout_buffer);
+        cerr.rdbuf(cerr_buffer);
+    }
+
+    ostringstream out;
+    ostringstream log;
+
+private:
+    fs::path working_dir;
+    streambuf * cout_buffer;
+    streambuf * cerr_buffer;
+};
+
+void test_watch_session()
+{
+    TemporaryDirectory dir("watch");
+
+    const string common =
+        "syntax = \"proto2\";\n"
+        "package Test;\n"
+        "message Common {\n"
+        "  optional int32 id = 1;\n"
+        "}\n";
+
+    dir.write("a/common.proto", common);
+    string changed_path = dir.write("b/common.proto", common);
+
+    ostringstream out, log;
+    WatchSession session({ dir.path("a") }, "common.proto", { dir.path("b") }, "common.proto",
+                         { "." }, Comparison::Options(), out, log);
+
+    confirm(out.str() == "/\n", "First report has no differences");
+    confirm(session.directories().size() == 2, "Both roots are watched");
+
+    out.str("");
+
+    // Comments and layout change the source locations only.
+    dir.write("b/common.proto",
+              "// Shared types.\n"
+              "syntax = \"proto2\";\n\n"
+              "package Test;\n\n"
+              "/* The common message. */\n"
+              "message Common\n"
+              "{\n"
+              "    optional int32 id = 1; // Identifier.\n"
+              "}\n");
+
+    confirm(!session.update({ changed_path }), "Comment and layout edits do not update");
+    confirm(out.str().empty(), "Comment and layout edits print nothing");
+
+    confirm(!session.update({ dir.path("b/unrelated.proto") }), "Files not loaded do not update");
+
+    dir.write("b/common.proto",
+              "syntax = \"proto2\";\n"
+              "package Test;\n"
+              "message Common {\n"
+              "  optional int64 id = 1;\n"
+              "}\n");
+
+    confirm(session.update({ changed_path }), "Changed definitions update");
+    confirm(out.str().find("Type changed: int32 -> int64") != string::npos, "Report shows the change");
+
+    out.str("");
+
+    dir.write("b/common.proto", "syntax = \"proto2\";\nmessage {\n");
+    confirm(!session.update({ changed_path }), "Failed load prints no report");
+    confirm(log.str().find("common.proto") != string::npos, "Failed load is logged");
+
+    dir.write("b/common.proto", common);
+    confirm(session.update({ changed_path }), "Fixed file updates");
+    confirm(out.str() == "/\n", "Report after fix has no differences");
+}
+
+void test_lru_cache()
+{
+    LruCache<string, int> cache(2);
+
+    cache.insert("a", 1);
+    cache.insert("b", 2);
+    confirm(cache.size() == 2, "Cache holds two entries");
+    confirm(cache.find("a") and *cache.find("a") == 1, "Finds an entry");
+    confirm(!cache.find("c"), "Does not find a missing entry");
+
+    // "a" was used last, so "b" makes room.
+    cache.insert("c", 3);
+    confirm(cache.size() == 2, "Cache stays at its capacity");
+    confirm(!cache.find("b"), "Least recently used entry is dropped");
+    confirm(cache.find("a") and cache.find("c"), "Recently used entries are kept");
+
+    // Replacing a value makes the entry the most recently used one.
+    cache.insert("a", 10);
+    cache.insert("d", 4);
+    confirm(cache.find("a") and *cache.find("a") == 10, "Replaced value is kept");
+    confirm(!cache.find("c"), "Entry used before the replaced one is dropped");
+
+    cache.erase("a");
+    cache.erase("missing");
+    confirm(cache.size() == 1 and !cache.find("a"), "Erased entry is gone");
+
+    LruCache<int, int> tiny(0);
+    tiny.insert(1, 1);
+    tiny.insert(2, 2);
+    confirm(tiny.size() == 1 and tiny.find(2), "Zero capacity holds one entry");
+}
+
+void test_daemon_handle()
+{
+    TemporaryDirectory dir("daemon");
+
+    dir.write("a/common.proto", "syntax = \"proto2\";\npackage Test;\nmessage Common { optional int32 id = 1; }\n");
+    dir.write("b/common.proto", "syntax = \"proto2\";\npackage Test;\nmessage Common { optional int64 id = 1; }\n");
+
+    DaemonServer server(Comparison::Options(), 4);
+
+    auto request = [&](const json & fields)
+    {
+        return json::parse(server.handle(fields.dump()));
+    };
+
+    json compare_a_b = {
+        { "dir1", dir.path("a") }, { "file1", "common.proto" },
+        { "dir2", dir.path("b") }, { "file2", "common.proto" }
+    };
+
+    auto answer = request(compare_a_b);
+    confirm(answer["differences"] == 1, "Difference is counted");
+    confirm(answer["report"].get<string>().find("Type changed: int32 -> int64") != string::npos, "Report is answered");
+    confirm(answer["latency_ms"].get<double>() >= 0, "Latency is reported");
+
+    answer = request(compare_a_b);
+    confirm(answer["differences"] == 1, "Cached sources give the same answer");
+
+    json compare_a_a = compare_a_b;
+    compare_a_a["dir2"] = dir.path("a");
+    answer = request(compare_a_a);
+    confirm(answer["differences"] == 0 and answer["report"] == "/\n", "Equal digests give an empty report");
+
+    auto stats = request({ { "command", "stats" } });
+    confirm(stats["requests"] == 3, "Requests are counted");
+    confirm(stats["sources"]["misses"] == 2, "Each source is loaded once");
+    confirm(stats["sources"]["hits"] == 4, "Cached sources are reused");
+    confirm(stats["digests"]["misses"] == 2, "Each digest is computed once");
+    confirm(stats["latency"]["max_ms"].get<double>() >= stats["latency"]["mean_ms"].get<double>(), "Latency statistics are kept");
+
+    // A changed file is noticed by its size and modification time.
+    dir.write("b/common.proto", "syntax = \"proto2\";\npackage Test;\nmessage Common { optional int32 id = 1; }\n\n");
+    answer = request(compare_a_b);
+    confirm(answer["differences"] == 0, "Changed file is loaded again");
+
+    json binary = compare_a_b;
+    binary["type"] = json::array({ "Test.Common" });
+    binary["binary"] = true;
+    answer = request(binary);
+    confirm(answer["differences"] == 0, "Selectors and options are taken from the request");
+
+    answer = request({ { "dir1", dir.path("a") }, { "file1", "missing.proto" },
+                       { "dir2", dir.path("b") }, { "file2", "common.proto" } });
+    confirm(answer.count("error") and answer["error"].get<string>().find("missing.proto") != string::npos,
+            "Missing file is an error");
+
+    answer = request({ { "dir1", dir.path("a") } });
+    confirm(answer["error"].get<string>().find("Invalid request") == 0, "Missing field is an invalid request");
+
+    answer = json::parse(server.handle("{not json"));
+    confirm(answer["error"].get<string>().find("Invalid request") == 0, "Malformed JSON is an invalid request");
+    confirm(answer.count("latency_ms"), "Errors report latency");
+
+    // Latency counts from when the request was received.
+    auto received = chrono::steady_clock::now() - chrono::milliseconds(50);
+    answer = json::parse(server.handle(json({ { "command", "stats" } }).dump(), received));
+    confirm(answer["latency_ms"].get<double>() >= 50, "Latency includes the time since the request was received");
+
+    stats = request({ { "command", "stats" } });
+    confirm(stats["errors"] == 3, "Errors are counted");
+}
+
+void test_mapped_file()
+{
+    TemporaryDirectory dir("mapped");
+
+    string path = dir.write("a.proto", "message A {}\n");
+    size_t held = MappedFile::held_count();
+
+    for (bool copy : { false, true })
+    {
+        MappedFile::copy_files(copy);
+
+        auto file = MappedFile::open(path);
+        confirm(file and string(file->data(), file->size()) == "message A {}\n", "File content is read");
+        confirm(MappedFile::open(dir.path("./a.proto")) == file, "Unchanged file is shared between paths");
+        confirm(MappedFile::held_count() == held + 1, "Held file is recorded once");
+
+        file.reset();
+        confirm(MappedFile::held_count() == held, "Released file is forgotten");
+    }
+
+    // A copy stays readable when the file is truncated.
+    auto file = MappedFile::open(path);
+    dir.write("a.proto", "");
+    confirm(string(file->data(), file->size()) == "message A {}\n", "Copied content survives truncation");
+
+    dir.write("a.proto", "message Bb {}\n");
+    auto changed = MappedFile::open(path);
+    confirm(changed != file and string(changed->data(), changed->size()) == "message Bb {}\n", "Changed file is read again");
+
+    file.reset();
+    confirm(MappedFile::held_count() == held + 1, "Replaced file leaves the new one recorded");
+
+    MappedFile::copy_files(false);
+}
+
+void test_mapped_source_tree_paths()
+{
+    using google::protobuf::compiler::DiskSourceTree;
+    using google::protobuf::io::ZeroCopyInputStream;
+
+    TemporaryDirectory dir("paths");
+
+    dir.write("a.proto", "syntax = \"proto2\";\npackage Test;\nmessage A {}\n");
+    dir.write("dir/b.proto", "syntax = \"proto2\";\npackage Test;\nmessage B {}\n");
+    dir.write("both.proto", "syntax = \"proto2\";\nimport \"a.proto\";\nimport \"./a.proto\";\n");
+
+    DiskSourceTree disk;
+    disk.MapPath("", dir.path());
+    MappedSourceTree mapped(dir.path());
+
+    // Paths are accepted and rejected as protoc does.
+    for (string path : vector<string> { "a.proto", "dir/b.proto", "./a.proto", "dir//b.proto", "dir/./b.proto",
+                         "dir/../a.proto", "../a.proto", "dir/", "dir", dir.path("a.proto"), "", "missing.proto" })
+    {
+        unique_ptr<ZeroCopyInputStream> from_disk(disk.Open(path));
+        unique_ptr<ZeroCopyInputStream> from_mapped(mapped.Open(path));
+
+        confirm(bool(from_disk) == bool(from_mapped), "Same result for \"" + path + "\"");
+        if (!from_disk)
+            confirm(disk.GetLastErrorMessage() == mapped.GetLastErrorMessage(), "Same error for \"" + path + "\"");
+    }
+
+    // Importing a file by another spelling fails as with protoc, instead of
+    // defining its types twice.
+    auto load_errors = [&](shared_ptr<google::protobuf::compiler::SourceTree> tree)
+    {
+        try
+        {
+            Source source("both.proto", tree);
+        }
+        catch (SourceError & e)
+        {
+            ostringstream errors;
+            e.diagnostics().print(errors);
+            return errors.str();
+        }
+        return string();
+    };
+
+    auto disk_tree = make_shared<DiskSourceTree>();
+    disk_tree->MapPath("", dir.path());
+    string errors = load_errors(make_shared<MappedSourceTree>(dir.path()));
+
+    confirm(errors.find("not allowed in the virtual path") != string::npos, "Other spelling is rejected");
+    confirm(errors == load_errors(disk_tree), "Same errors as protoc");
+
+    // Several roots keep the reason of an inner tree, also when asked again.
+    unique_ptr<ZeroCopyInputStream>(disk.Open("./a.proto"));
+    auto roots = open_source_tree(vector<string> { dir.path("dir"), dir.path() });
+    confirm(load_errors(roots) == errors, "Same errors with several roots");
+    for (int i = 0; i < 2; ++i)
+    {
+        unique_ptr<ZeroCopyInputStream> stream(roots->Open("./a.proto"));
+        confirm(!stream and roots->GetLastErrorMessage() == disk.GetLastErrorMessage(),
+                "Invalid path is reported by several roots");
+    }
+    unique_ptr<ZeroCopyInputStream> stream(roots->Open("missing.proto"));
+    confirm(!stream and roots->GetLastErrorMessage() == "File not found.", "Missing file is not found in several roots");
+}
+
+void test_git_source_tree()
+{
+    GitHistory history("git");
+
+    const string first = "syntax = \"proto2\";\npackage Test;\nmessage A { optional int32 id = 1; }\n";
+    const string second = "syntax = \"proto2\";\npackage Test;\nmessage A { optional int64 id = 1; }\n";
+
+    string commit1 = history.commit({ { "protos/a.proto", first } });
+    string commit2 = history.commit({ { "protos/a.proto", second }, { "protos/b.proto", "" } });
+
+    auto repository = GitRepository::open(history.path());
+    confirm(repository == GitRepository::open(history.path()), "Repository is shared");
+    confirm(repository->commit_id("HEAD") == commit2, "Revision is resolved");
+    confirm(repository->commit_id("HEAD~1") == commit1, "Relative revision is resolved");
+    confirm(repository->commit_id(commit1.substr(0, 10)) == commit1, "Abbreviated id is resolved");
+
+    bool failed = false;
+    try
+    {
+        repository->commit_id("no-such-branch");
+    }
+    catch (std::runtime_error &)
+    {
+        failed = true;
+    }
+    confirm(failed, "Unknown revision throws");
+
+    string id, type;
+    confirm(repository->check("HEAD:protos", &id, &type) and type == "tree" and id == history.id("HEAD:protos"),
+            "Check finds a tree");
+    confirm(!repository->check("HEAD:missing", &id), "Check misses a missing object");
+
+    GitSourceTree tree(repository, "HEAD~1", "protos/");
+    confirm(tree.commit() == commit1, "Tree is at the revision's commit");
+    confirm(tree.blob_id("a.proto") == history.id("HEAD~1:protos/a.proto"), "Blob id is found");
+    confirm(tree.blob_id("b.proto").empty(), "Missing file has no blob id");
+
+    GitSourceTree root_tree(repository, "HEAD");
+    confirm(root_tree.blob_id("protos").empty(), "Directory has no blob id");
+
+    string content;
+    confirm(tree.read("a.proto", &content, &id) and content == first and id == tree.blob_id("a.proto"),
+            "File is read with its blob id");
+    // Checks and reads are answered by separate processes.
+    confirm(root_tree.read("protos/a.proto", &content, nullptr) and content == second, "File is read at another revision");
+
+    // "git:" roots name revisions of the repository of the working directory.
+    auto working_dir = fs::current_path();
+    fs::current_path(history.path());
+
+    Source source1("a.proto", open_source_tree(vector<string> { "git:HEAD~1:protos" }));
+    Source source2("protos/a.proto", open_source_tree(vector<string> { "git:" + commit2 }));
+
+    fs::current_path(working_dir);
+
+    Comparison::Options options;
+    Comparison comparison(options);
+    comparison.run(source1, source2, { "." });
+
+    ostringstream report;
+    comparison.root.print(report);
+    confirm(report.str().find("Type changed: int32 -> int64") != string::npos, "Revisions are compared");
+}
+
+void test_renamed_fields()
+{
+    // A wide message of one type, with every field renamed.
+    const int count = 2000;
+    string fields1, fields2;
+    for (int i = 0; i < count; ++i)
+    {
+        fields1 += " optional string value_" + to_string(i) + " = " + to_string(i + 1) + ";";
+        fields2 += " optional string values_" + to_string(i) + " = " + to_string(i + 1) + ";";
+    }
+    fields1 += " optional string customer_email = 5000;";
+    fields2 += " optional string customer_mail = 5000;";
+
+    Source source1("a.proto", map<string, string> { { "a.proto", "syntax = \"proto2\";\nmessage Wide {" + fields1 + " }\n" } });
+    Source source2("b.proto", map<string, string> { { "b.proto", "syntax = \"proto2\";\nmessage Wide {" + fields2 + " }\n" } });
+
+    auto * desc1 = source1.pool()->FindMessageTypeByName("Wide");
+    auto * desc2 = source2.pool()->FindMessageTypeByName("Wide");
+
+    auto matching = match_fields_by_name(desc1, desc2);
+    size_t scored = pair_renamed_fields(desc1, desc2, matching, 0.3);
+
+    confirm(scored < size_t(count) * count / 100, "Renames in a wide message of one type score few pairs");
+    confirm(matching.first_to_second[count] == count, "Field with distinctive bigrams is paired");
+}
+
+void test_timeline()
+{
+    GitHistory history("timeline");
+
+    const string a = "syntax = \"proto2\";\npackage Test;\nmessage A { optional int32 id = 1; }\n";
+
+    history.commit({ { "README", "Protocol definitions.\n" } });
+    string base = history.id("HEAD");
+    string added = history.commit({ { "protos/a.proto", a } });
+    string commented = history.commit({ { "protos/a.proto", "// The A message.\n" + a } });
+    string unrelated = history.commit({ { "README", "Definitions.\n" } });
+    string changed = history.commit({ { "protos/a.proto", "syntax = \"proto2\";\npackage Test;\nmessage A { optional int64 id = 1; }\n" } });
+    string broken = history.commit({ { "protos/a.proto", "syntax = \"proto2\";\nmessage {\n" } });
+    string fixed = history.commit({ { "protos/a.proto", a } });
+
+    int result;
+    string out, log;
+    {
+        CapturedRun run(history.path());
+        result = run_timeline(base + "..HEAD", "protos", "a.proto", { "." }, Comparison::Options());
+        out = run.out.str();
+        log = run.log.str();
+    }
+
+    confirm(result == 0, "Timeline succeeds");
+
+    // Errors are followed by their diagnostics.
+    vector<string> expected {
+        added.substr(0, 12) + " added\n",
+        commented.substr(0, 12) + " compatible\n",
+        unrelated.substr(0, 12) + " unchanged\n",
+        changed.substr(0, 12) + " changed: 1 difference\n",
+        broken.substr(0, 12) + " error: ",
+        fixed.substr(0, 12) + " changed: 1 difference\n",
+    };
+
+    size_t position = 0;
+    for (auto & line : expected)
+    {
+        position = out.find(line, position);
+        confirm(position != string::npos and (position == 0 or out[position - 1] == '\n'), "Timeline has: " + line);
+    }
+
+    // The broken version parses to nothing, and the fixed one is cached.
+    confirm(log.find("Parsed 3 file versions for 6 commits.") != string::npos, "File versions are parsed once");
+
+    CapturedRun run(history.path());
+    confirm(run_timeline("no-such-branch..HEAD", "protos", "a.proto", { "." }, Comparison::Options()) == 1,
+            "Unknown range fails");
+}
+
+void test_bisect()
+{
+    GitHistory history("bisect");
+
+    const string a = "syntax = \"proto2\";\npackage Test;\nmessage A { optional int32 id = 1; }\n";
+    const string a_changed = "syntax = \"proto2\";\npackage Test;\nmessage A { optional int64 id = 1; }\n";
+
+    string good = history.commit({ { "protos/a.proto", a } });
+
+    // Seven commits, the fifth of which changes a type.
+    vector<string> commits;
+    for (int i = 0; i < 7; ++i)
+    {
+        string content = i < 4 ? a : a_changed;
+        commits.push_back(history.commit({ { "protos/a.proto", "// Revision " + to_string(i) + "\n" + content } }));
+    }
+
+    int result;
+    string out, log;
+    {
+        CapturedRun run(history.path());
+        result = run_bisect(good, "HEAD", "protos", "a.proto", { "." }, Comparison::Options());
+        out = run.out.str();
+        log = run.log.str();
+    }
+
+    confirm(result == 0, "Bisect succeeds");
+    confirm(out.find("First incompatible commit: " + commits[4] + "\n") == 0, "First bad commit is found");
+    confirm(out.find("Type changed: int32 -> int64") != string::npos, "Report of the first bad commit is printed");
+    // The last commit, then commits 3, 5 and 4.
+    confirm(log.find("Tested 4 of 7 commits.") != string::npos, "Binary search probes 4 commits");
+
+    {
+        CapturedRun run(history.path());
+        result = run_bisect(good, commits[3], "protos", "a.proto", { "." }, Comparison::Options());
+        out = run.out.str();
+    }
+
+    confirm(result == 0 and out.find("No incompatible commit") == 0, "Compatible range has no bad commit");
+
+    CapturedRun run(history.path());
+    confirm(run_bisect("no-such-branch", "HEAD", "protos", "a.proto", { "." }, Comparison::Options()) == 1,
+            "Unknown revision fails");
+}
+
+void test_batch()
+{
+    TemporaryDirectory dir("batch");
+
+    dir.write("v1/a.proto", "syntax = \"proto2\";\npackage Test;\nmessage A { optional int32 id = 1; }\n");
+    dir.write("v2/a.proto", "syntax = \"proto2\";\npackage Test;\nmessage A { optional int64 id = 1; }\n");
+
+    dir.write("manifest.jsonl",
+              "{\"dir1\": \"v1\", \"file1\": \"a.proto\", \"dir2\": \"v2\", \"file2\": \"a.proto\", \"type\": \"Test.A\"}\n"
+              "\n"
+              "{\"dir1\": \"v1\", \"file1\": \"a.proto\", \"dir2\": \"v1\", \"file2\": \"a.proto\", \"type\": [\".\"]}\n"
+              "{\"dir1\": \"v1\", \"file1\": \"a.proto\", \"dir2\": \"v2\", \"file2\": \"a.proto\", \"type\": \".\", \"output\": \"a.diff\"}\n");
+
+    // Reports are printed in manifest order, whatever the number of threads.
+    string outputs[2];
+    for (unsigned int threads : { 1, 4 })
+    {
+        CapturedRun run(dir.path());
+        confirm(run_batch("manifest.jsonl", Comparison::Options(), threads) == 0, "Batch succeeds");
+        outputs[threads == 4] = run.out.str();
+        confirm(run.log.str().empty(), "Batch logs nothing");
+    }
+
+    string & out = outputs[0];
+    confirm(outputs[0] == outputs[1], "Output does not depend on the number of threads");
+    confirm(out.find("== v1 a.proto -> v2 a.proto Test.A\n") == 0, "First entry comes first");
+    confirm(out.find("Type changed: int32 -> int64") != string::npos, "Report is printed");
+    confirm(out.find("== v1 a.proto -> v1 a.proto .\n/\n") != string::npos, "Array of selectors is accepted");
+    confirm(out.find("-> v2 a.proto .") == string::npos, "Entries with an output file are not printed");
+
+    ifstream diff(dir.path("a.diff"));
+    string report((istreambuf_iterator<char>(diff)), istreambuf_iterator<char>());
+    confirm(report.find("Type changed: int32 -> int64") != string::npos, "Report is written to the output file");
+
+    // A failing entry fails the batch, but not the other entries.
+    dir.write("failing.jsonl",
+              "{\"dir1\": \"v1\", \"file1\": \"a.proto\", \"dir2\": \"v2\", \"file2\": \"a.proto\", \"type\": \".\"}\n"
+              "{\"dir1\": \"v1\", \"file1\": \"missing.proto\", \"dir2\": \"v2\", \"file2\": \"a.proto\", \"type\": \".\"}\n");
+    {
+        CapturedRun run(dir.path());
+        confirm(run_batch("failing.jsonl", Comparison::Options(), 2) == 1, "Failing entry fails the batch");
+        confirm(run.out.str().find("Type changed") != string::npos, "Other entries are still reported");
+        confirm(run.log.str().find("Entry 2: ") == 0 and run.log.str().find("missing.proto") != string::npos,
+                "Failing entry is logged");
+    }
+
+    // A bad manifest line stops the batch before any comparison.
+    for (string line : { "{\"dir1\": \"v1\"", "{\"dir1\": \"v1\", \"file1\": \"a.proto\", \"dir2\": \"v2\", \"file2\": \"a.proto\"}",
+                         "{\"dir1\": 1, \"file1\": \"a.proto\", \"dir2\": \"v2\", \"file2\": \"a.proto\", \"type\": \".\"}" })
+    {
+        dir.write("bad.jsonl",
+                  "{\"dir1\": \"v1\", \"file1\": \"a.proto\", \"dir2\": \"v2\", \"file2\": \"a.proto\", \"type\": \".\"}\n" + line + "\n");
+
+        CapturedRun run(dir.path());
+        confirm(run_batch("bad.jsonl", Comparison::Options(), 2) == 1, "Bad manifest line fails: " + line);
+        confirm(run.out.str().empty(), "Nothing is compared");
+        confirm(run.log.str().find("bad.jsonl:2: ") == 0, "Bad line is located");
+    }
+
+    CapturedRun run(dir.path());
+    confirm(run_batch("missing.jsonl", Comparison::Options(), 1) == 1, "Missing manifest fails");
+    confirm(run.log.str().find("Failed to open manifest") == 0, "Missing manifest is logged");
+}
+
+void test_chain()
+{
+    vector<pair<string, string>> versions {
+        { "chain/v1", "a.proto" }, { "chain/v2", "a.proto" }, { "chain/v3", "a.proto" }
+    };
+
+    {
+        CapturedRun run(".");
+        confirm(run_chain(versions, { "." }, Comparison::Options()) == 0, "Chain succeeds");
+        confirm(run.out.str() ==
+                "== Step 1: chain/v1 a.proto -> chain/v2 a.proto\n"
+                "/\n"
+                "  Comparing messages: Test.A -> Test.A\n"
+                "    * Field added:  -> name\n"
+                "== Step 2: chain/v2 a.proto -> chain/v3 a.proto\n"
+                "/\n"
+                "  Comparing messages: Test.A -> Test.A\n"
+                "    Comparing fields: id -> id\n"
+                "      * Type changed: int32 -> int64\n",
+                "Each version is compared with the next one");
+    }
+
+    // Steps before a version that fails to load are still reported.
+    versions.insert(versions.begin() + 2, { "chain/v2", "missing.proto" });
+
+    CapturedRun run(".");
+    confirm(run_chain(versions, { "." }, Comparison::Options()) == 1, "Missing version fails the chain");
+    confirm(run.out.str().find("== Step 1:") == 0 and run.out.str().find("== Step 2:") == string::npos,
+            "Chain stops at the missing version");
+    confirm(run.log.str().find("chain/v2 missing.proto: ") == 0, "Missing version is logged");
+}
+
+void test_matrix()
+{
+    TemporaryDirectory dir("matrix");
+
+    dir.write("v1/a.proto",
+              "syntax = \"proto2\";\npackage Test;\n"
+              "message A { optional int32 id = 1; }\nmessage B { optional int64 id = 1; }\n");
+    // Same structure, other layout.
+    dir.write("v2/a.proto",
+              "syntax = \"proto2\";\n\npackage Test;\n\n// Comment.\n"
+              "message A\n{\n    optional int32 id = 1;\n}\n\nmessage B\n{\n    optional int64 id = 1;\n}\n");
+    dir.write("v3/a.proto",
+              "syntax = \"proto2\";\npackage Test;\n"
+              "message A { optional int64 id = 1; }\nmessage B { optional int64 id = 1; }\n");
+
+    Source source1("a.proto", dir.path("v1"));
+    Source source2("a.proto", dir.path("v2"));
+    Source source3("a.proto", dir.path("v3"));
+
+    confirm(StructuralDigest().digest(source1, { "." }) == StructuralDigest().digest(source2, { "." }),
+            "Equal structures have equal digests");
+    confirm(StructuralDigest().digest(source1, { "." }) != StructuralDigest().digest(source3, { "." }),
+            "Changed structure changes the digest");
+    confirm(StructuralDigest().digest(source1, { "Test.B" }) == StructuralDigest().digest(source3, { "Test.B" }),
+            "Digest covers the selected types only");
+
+    vector<pair<string, string>> versions {
+        { "v1", "a.proto" }, { "v2", "a.proto" }, { "v3", "a.proto" }
+    };
+
+    const string header =
+        "   1: v1 a.proto\n"
+        "   2: v2 a.proto\n"
+        "   3: v3 a.proto\n"
+        "\n"
+        "         1     2     3\n";
+
+    // Pairs with equal digests are marked "=" without being compared.
+    {
+        CapturedRun run(dir.path());
+        confirm(run_matrix(versions, { "." }, Comparison::Options(), 2) == 0, "Matrix succeeds");
+        confirm(run.out.str() == header +
+                "   1     -     =     1\n"
+                "   2     =     -     1\n"
+                "   3     1     1     -\n",
+                "Equal digests skip the comparison");
+    }
+
+    // A mapping pairs A with B, so equal digests do not mean no differences.
+    auto mapping = make_shared<TypeMapping>();
+    mapping->add_exact("Test.A", "Test.B");
+
+    Comparison::Options options;
+    options.type_mapping = mapping;
+
+    {
+        CapturedRun run(dir.path());
+        confirm(run_matrix(versions, { "Test.A" }, options, 2) == 0, "Matrix with a mapping succeeds");
+        confirm(run.out.str() == header +
+                "   1     -     1     1\n"
+                "   2     1     -     1\n"
+                "   3     0     0     -\n",
+                "Type mapping disables the digest shortcut");
+    }
+
+    versions.emplace_back("v3", "missing.proto");
+
+    CapturedRun run(dir.path());
+    confirm(run_matrix(versions, { "." }, Comparison::Options(), 2) == 1, "Missing version fails");
+    confirm(run.out.str().find("   4     !     !     !     -\n") != string::npos, "Missing version is marked");
+}
+
+void test_moved_types()
+{
+    // Many types with the same fields, all moved to another package
+    // in an imported file.
+    const int count = 500;
+    string fields;
+    for (int i = 1; i <= 8; ++i)
+        fields += " optional int32 f" + to_string(i) + " = " + to_string(i) + ";";
+
+    string old_types = "syntax = \"proto2\";\npackage Old;\n";
+    string new_types = "syntax = \"proto2\";\npackage New;\n";
+    string unlike_types = "syntax = \"proto2\";\npackage New;\n";
+    for (int i = 0; i < count; ++i)
+    {
+        old_types += "message M" + to_string(i) + " {" + fields + " }\n";
+        new_types += "message M" + to_string(i) + " {" + fields + " }\n";
+        unlike_types += "message N" + to_string(i) + " {" + fields + " }\n";
+    }
+
+    Source source1("a.proto", map<string, string> { { "a.proto", old_types } });
+    string importer = "syntax = \"proto2\";\nimport \"moved.proto\";\n";
+    Source source2("b.proto", map<string, string> { { "b.proto", importer }, { "moved.proto", new_types } });
+    Source source3("b.proto", map<string, string> { { "b.proto", importer }, { "moved.proto", unlike_types } });
+
+    auto * file1 = source1.file_descriptor();
+    auto * file2 = source2.file_descriptor();
+
+    auto moves = find_moved_types(file1, file2, 0.5);
+
+    bool by_name = moves.messages.size() == count;
+    for (auto & move : moves.messages)
+        by_name = by_name and move.first->name() == move.second->name();
+    confirm(by_name, "Types with identical signatures are paired by name");
+
+    // Types differing only in name share most buckets, which are too
+    // crowded to search, so most of them are not paired.
+    moves = find_moved_types(file1, source3.file_descriptor(), 0.5);
+    confirm(moves.messages.size() < count / 2, "Crowded buckets are not searched");
+
+    TypeMapping mapping;
+    mapping.add_exact("Old.M0", "New.M1");
+
+    moves = find_moved_types(file1, file2, 0.5, &mapping);
+    bool unmapped = !moves.messages.count(file1->FindMessageTypeByName("M0"));
+    for (auto & move : moves.messages)
+        unmapped = unmapped and move.second->full_name() != "New.M1";
+    confirm(unmapped, "Types paired by the mapping are not moved");
+    confirm(moves.messages.at(file1->FindMessageTypeByName("M2"))->full_name() == "New.M2",
+            "Other types are still paired");
+}
+
+// Reads a whole file from a source tree, or returns "" if it is not there.
+string read_from(google::protobuf::compiler::SourceTree & tree, const string & filename)
+{
+    unique_ptr<google::protobuf::io::ZeroCopyInputStream> input(tree.Open(filename));
+    if (!input)
+        return "";
+
+    string content;
+    const void * data;
+    int size;
+    while (input->Next(&data, &size))
+        content.append(static_cast<const char*>(data), size);
+
+    return content;
+}
+
+void test_archive_source_tree()
+{
+    // The same files in each archive: user.proto, deflated in the zip, and
+    // a file with a path longer than 100 characters, stored in the zip, in
+    // a GNU long name member in the tar and a pax header in the tgz.
+    const string long_name = "deeply_nested_directory_with_a_name_long_enough/"
+                             "deeply_nested_directory_with_a_name_long_enough/common.proto";
+    const vector<string> archives { "archives/protos.tar", "archives/protos.tgz", "archives/protos.zip" };
+
+    for (auto & archive : archives)
+        confirm(ArchiveSourceTree::is_archive(archive), "Archive is recognized: " + archive);
+    confirm(!ArchiveSourceTree::is_archive("archives"), "Directory is not an archive");
+
+    string user;
+
+    for (auto & archive : archives)
+    {
+        ArchiveSourceTree tree(archive, "protos");
+
+        string content = read_from(tree, "user.proto");
+        confirm(content.find("message User") != string::npos and content.find("import \"" + long_name + "\"") != string::npos,
+                "Member is read from " + archive);
+        confirm(user.empty() or content == user, "Members are the same in " + archive);
+        user = content;
+
+        confirm(read_from(tree, long_name).find("message Common") != string::npos, "Long name is read from " + archive);
+
+        confirm(!tree.Open("missing.proto") and tree.GetLastErrorMessage() == "File not found.",
+                "Missing member is not found in " + archive);
+
+        ArchiveSourceTree root(archive);
+        confirm(read_from(root, "protos/user.proto") == user, "Member is read from the root of " + archive);
+    }
+
+    // Imports resolve inside the archive, so all archives load the same types.
+    Source tar("user.proto", open_source_tree(vector<string> { "archives/protos.tar:protos" }));
+    for (auto & archive : archives)
+    {
+        Source other("user.proto", open_source_tree(vector<string> { archive + ":protos" }));
+
+        Comparison::Options options;
+        Comparison comparison(options);
+        comparison.run(tar, other, { "." });
+
+        ostringstream report;
+        comparison.root.print(report);
+        confirm(report.str() == "/\n", "Same types are loaded from " + archive);
+    }
+
+    TemporaryDirectory dir("archive");
+    // A zip signature without a central directory.
+    string corrupt = dir.write("corrupt.zip", "PK\x03\x04 without a central directory.");
+
+    bool failed = false;
+    try
+    {
+        ArchiveSourceTree tree(corrupt);
+    }
+    catch (std::runtime_error &)
+    {
+        failed = true;
+    }
+    confirm(failed, "Corrupt archive throws");
+}
+
+void test_diagnostics()
+{
+    ErrorCollector errors(3, 5);
+
+    errors.AddError("a.proto", 1, 2, "Expected \"message\".");
+    errors.AddError("a.proto", 1, 2, "Expected \"message\".");
+    confirm(errors.diagnostics().items.size() == 1 and !errors.diagnostics().dropped, "Repeated diagnostic is kept once");
+
+    errors.AddWarning("a.proto", 3, 0, "Import unused.");
+    errors.AddError("a.proto", 4, 0, "Third.");
+    errors.AddError("a.proto", 5, 0, "Fourth.");
+    errors.AddError("a.proto", 6, 0, "Fifth.");
+    confirm(errors.diagnostics().items.size() == 3 and errors.diagnostics().dropped == 2, "Diagnostics per file are limited");
+    confirm(errors.should_stop("a.proto"), "File with errors over its limit stops");
+
+    errors.AddWarning("b.proto", -1, 0, "Warning.");
+    errors.AddError("c.proto", 0, 0, "Error.");
+    errors.AddError("c.proto", 1, 0, "Over the total.");
+    errors.AddError("d.proto", 0, 0, "Over the total.");
+    confirm(errors.diagnostics().items.size() == 5 and errors.diagnostics().dropped == 4, "Diagnostics in all are limited");
+    confirm(!errors.should_stop("b.proto"), "File with warnings only does not stop");
+    confirm(errors.should_stop("d.proto"), "File with errors over the total stops");
+
+    auto & diagnostics = errors.diagnostics();
+    confirm(diagnostics.has_errors(), "Errors are found");
+
+    ostringstream text;
+    diagnostics.print(text);
+    confirm(text.str() ==
+            "Error: a.proto@1,2: Expected \"message\".\n"
+            "Warning: a.proto@3,0: Import unused.\n"
+            "Error: a.proto@4,0: Third.\n"
+            "Warning: b.proto@-1,0: Warning.\n"
+            "Error: c.proto@0,0: Error.\n"
+            "(4 more diagnostics not shown)\n",
+            "Diagnostics are printed");
+
+    auto parsed = json::parse(diagnostics.json());
+    confirm(parsed["dropped"] == 4 and parsed["diagnostics"].size() == 5, "JSON has the kept and dropped diagnostics");
+    confirm(parsed["diagnostics"][0] == json({ { "severity", "error" }, { "file", "a.proto" }, { "line", 1 },
+                                               { "column", 2 }, { "message", "Expected \"message\"." } }),
+            "JSON diagnostic has all fields");
+    confirm(parsed["diagnostics"][1]["severity"] == "warning", "JSON has warnings");
+
+    // Loading a broken file reports its diagnostics, up to the default limit.
+    string broken = "syntax = \"proto2\";\n";
+    for (int i = 0; i < 30; ++i)
+        broken += "message M" + to_string(i) + " { optional Missing" + to_string(i) + " f = 1; }\n";
+
+    try
+    {
+        Source source("broken.proto", map<string, string> { { "broken.proto", broken } });
+        confirm(false, "Broken file fails to load");
+    }
+    catch (SourceError & e)
+    {
+        confirm(e.diagnostics().items.size() == 20 and e.diagnostics().dropped == 10, "Loading keeps 20 diagnostics per file");
+        confirm(string(e.what()).find("(10 more diagnostics not shown)") != string::npos, "Failure message counts dropped diagnostics");
+    }
+}
+
+// Runs a language server on pipes, as an editor would.
+class LanguageClient
+{
+public:
+    LanguageClient(const vector<string> & baseline_roots, const vector<string> & workspace_roots)
+    {
+        if (pipe(requests) != 0 or pipe(responses) != 0)
+            throw runtime_error("Failed to create pipes");
+
+        server = thread([=]
+        {
+            exit_code = run_language_server(baseline_roots, workspace_roots, Comparison::Options(),
+                                            requests[0], responses[1]);
+            ::close(responses[1]);
+        });
+    }
+
+    // Ends the input, so that the server stops if it did not exit.
+    ~LanguageClient()
+    {
+        close();
+        ::close(requests[0]);
+        ::close(responses[0]);
+    }
+
+    void send(const json & message)
+    {
+        send_raw(frame(message.dump()));
+    }
+
+    void send_raw(const string & data)
+    {
+        if (write(requests[1], data.data(), data.size()) != ssize_t(data.size()))
+            throw runtime_error("Failed to send");
+    }
+
+    static string frame(const string & body)
+    {
+        return "Content-Length: " + to_string(body.size()) + "\r\n\r\n" + body;
+    }
+
+    // Waits for the next message.
+    json receive()
+    {
+        while (true)
+        {
+            size_t end = buffer.find("\r\n\r\n");
+            if (end != string::npos)
+            {
+                size_t length = stoul(buffer.substr(buffer.find(':') + 1));
+                if (buffer.size() >= end + 4 + length)
+                {
+                    auto message = json::parse(buffer.substr(end + 4, length));
+                    buffer.erase(0, end + 4 + length);
+                    return message;
+                }
+            }
+
+            pollfd request { responses[0], POLLIN, 0 };
+            if (poll(&request, 1, 10000) <= 0)
+                throw runtime_error("No message from the server");
+
+            char chunk[4096];
+            ssize_t length = read(responses[0], chunk, sizeof(chunk));
+            if (length <= 0)
+                throw runtime_error("Server closed its output");
+            buffer.append(chunk, length);
+        }
+    }
+
+    // Waits for diagnostics published for the uri.
+    json diagnostics(const string & uri)
+    {
+        auto message = receive();
+        confirm(message.value("method", "") == "textDocument/publishDiagnostics", "Diagnostics are published");
+        confirm(message["params"]["uri"] == uri, "Diagnostics are for " + uri);
+        return message["params"]["diagnostics"];
+    }
+
+    // Closes the input and returns the exit code of the server.
+    int close()
+    {
+        if (requests[1] >= 0)
+        {
+            ::close(requests[1]);
+            requests[1] = -1;
+        }
+        if (server.joinable())
+            server.join();
+        return exit_code;
+    }
+
+private:
+    int requests[2];
+    int responses[2];
+    thread server;
+    int exit_code = -1;
+    string buffer;
+};
+
+void test_language_server()
+{
+    TemporaryDirectory dir("lsp");
+
+    const string a_text = "syntax = \"proto2\";\npackage Test;\nmessage A {\n\toptional int32 x = 1;\n}\n";
+    const string b_text = "syntax = \"proto2\";\npackage Test;\nimport \"a.proto\";\nmessage B { optional A a = 1; }\n";
+
+    for (auto side : { "base", "work" })
+    {
+        dir.write(string(side) + "/a.proto", a_text);
+        dir.write(string(side) + "/b.proto", b_text);
+    }
+
+    string a_uri = "file://" + dir.path("work/a.proto");
+    string b_uri = "file://" + dir.path("work/b.proto");
+
+    LanguageClient client({ dir.path("base") }, { dir.path("work") });
+
+    client.send({ { "jsonrpc", "2.0" }, { "id", 1 }, { "method", "initialize" }, { "params", json::object() } });
+    auto answer = client.receive();
+    confirm(answer["id"] == 1 and answer["result"]["capabilities"]["textDocumentSync"]["change"] == 1,
+            "Initialize answers full synchronization");
+
+    // A frame with a bad length is dropped, and the next one is read.
+    client.send_raw("Content-Length: abc\r\n\r\n{}");
+
+    auto open = [&](const string & uri, const string & text)
+    {
+        client.send({ { "jsonrpc", "2.0" }, { "method", "textDocument/didOpen" }, { "params", {
+            { "textDocument", { { "uri", uri }, { "languageId", "proto" }, { "version", 1 }, { "text", text } } } } } });
+    };
+
+    auto change = [&](const string & uri, const string & text)
+    {
+        client.send({ { "jsonrpc", "2.0" }, { "method", "textDocument/didChange" }, { "params", {
+            { "textDocument", { { "uri", uri }, { "version", 2 } } },
+            { "contentChanges", json::array({ { { "text", text } } }) } } } });
+    };
+
+    open(b_uri, b_text);
+    confirm(client.diagnostics(b_uri).empty(), "Unchanged document has no diagnostics");
+
+    open(a_uri, "syntax = \"proto2\";\npackage Test;\nmessage A {\n\toptional int32 x = 1;\n\toptional int32 y = 2;\n}\n");
+    auto diagnostics = client.diagnostics(a_uri);
+    confirm(diagnostics.size() == 1, "Added field is reported");
+    confirm(diagnostics[0]["message"].get<string>().find("Field added") != string::npos, "Diagnostic describes the change");
+    confirm(diagnostics[0]["severity"] == 2, "Differences are warnings");
+    confirm(diagnostics[0]["range"]["start"] == json({ { "line", 4 }, { "character", 1 } }),
+            "Diagnostic is at the field, after the tab");
+
+    // Importers of a changed document are checked again.
+    confirm(!client.diagnostics(b_uri).empty(), "Importer sees the open document");
+
+    change(a_uri, "syntax = \"proto2\";\npackage Test;\nmessage A {\n\toptional int64 x = 1;\n}\n");
+    diagnostics = client.diagnostics(a_uri);
+    confirm(diagnostics.size() == 1 and diagnostics[0]["message"].get<string>().find("Type changed: int32 -> int64") != string::npos,
+            "Changed document is checked again");
+    client.diagnostics(b_uri);
+
+    change(a_uri, "syntax = \"proto2\";\npackage Test;\nmessage A {\n");
+    diagnostics = client.diagnostics(a_uri);
+    confirm(!diagnostics.empty() and diagnostics[0]["severity"] == 1, "Parse errors are reported as errors");
+    client.diagnostics(b_uri);
+
+    // The importer sees the file on disk again, which is unchanged.
+    client.send({ { "jsonrpc", "2.0" }, { "method", "textDocument/didClose" }, { "params", {
+        { "textDocument", { { "uri", a_uri } } } } } });
+    confirm(client.diagnostics(a_uri).empty(), "Closed document's diagnostics are cleared");
+    confirm(client.diagnostics(b_uri).empty(), "Importer is checked against the file on disk");
+
+    client.send({ { "jsonrpc", "2.0" }, { "id", 2 }, { "method", "textDocument/hover" }, { "params", json::object() } });
+    answer = client.receive();
+    confirm(answer["id"] == 2 and answer["error"]["code"] == -32601, "Unknown requests are answered with an error");
+
+    client.send({ { "jsonrpc", "2.0" }, { "id", 3 }, { "method", "shutdown" } });
+    answer = client.receive();
+    confirm(answer["id"] == 3 and answer["result"].is_null(), "Shutdown is answered");
+
+    client.send({ { "jsonrpc", "2.0" }, { "method", "exit" } });
+    confirm(client.close() == 0, "Server exits after shutdown");
+}
+
+int main(int argc, char * argv[])
+{
+    map<string, function<void()>> tests {
+        { "archive_source_tree", test_archive_source_tree },
+        { "batch", test_batch },
+        { "bisect", test_bisect },
+        { "chain", test_chain },
+        { "daemon_handle", test_daemon_handle },
+        { "diagnostics", test_diagnostics },
+        { "git_source_tree", test_git_source_tree },
+        { "language_server", test_language_server },
+        { "lru_cache", test_lru_cache },
+        { "mapped_file", test_mapped_file },
+        { "mapped_source_tree_paths", test_mapped_source_tree_paths },
+        { "matrix", test_matrix },
+        { "moved_types", test_moved_types },
+        { "renamed_fields", test_renamed_fields },
+        { "timeline", test_timeline },
+        { "watch_session", test_watch_session },
+    };
+
+    if (argc != 2 or !tests.count(argv[1]))
+    {
+        cerr << "Expected argument: <test name>" << endl;
+        return 1;
+    }
+
+    try
+    {
+        tests[argv[1]]();
+    }
+    catch (std::exception & e)
+    {
+        cerr << "Failed: " << e.what() << endl;
+        return 1;
+    }
+
+    cerr << "OK." << endl;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads running submitted tasks in FIFO order.
+
+class ThreadPool
+{
+public:
+    // Zero threads means one per hardware thread.
+    ThreadPool(unsigned int thread_count = 0)
+    {
+        if (!thread_count)
+            thread_count = std::max(1u, std::thread::hardware_concurrency());
+
+        for (unsigned int i = 0; i < thread_count; ++i)
+            threads.emplace_back([this]{ work(); });
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        task_available.notify_all();
+
+        for (auto & thread : threads)
+            thread.join();
+    }
+
+    void submit(std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back(std::move(task));
+            ++unfinished;
+        }
+        task_available.notify_one();
+    }
+
+    // Blocks until all submitted tasks have finished.
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        all_finished.wait(lock, [this]{ return unfinished == 0; });
+    }
+
+    unsigned int size() const { return threads.size(); }
+
+private:
+    void work()
+    {
+        while (true)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                task_available.wait(lock, [this]{ return stopping or !tasks.empty(); });
+                if (tasks.empty())
+                    return;
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+
+            task();
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (--unfinished == 0)
+                    all_finished.notify_all();
+            }
+        }
+    }
+
+    std::vector<std::thread> threads;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable task_available;
+    std::condition_variable all_finished;
+    size_t unfinished = 0;
+    bool stopping = false;
+};
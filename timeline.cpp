@@ -0,0 +1,263 @@
+#include "timeline.h"
+#include "parse_cache.h"
+
+#include <iostream>
+
+using namespace std;
+
+namespace {
+
+struct Version
+{
+    string commit;
+    shared_ptr<ErrorCollector> errors;
+    shared_ptr<GitDescriptorDatabase> database;
+    shared_ptr<Source> source;
+};
+
+// Loads a file at revisions of one repository, sharing parsed files
+// between all revisions.
+class History
+{
+public:
+    History(shared_ptr<GitRepository> repository, const string & root_dir, const string & file_path):
+        repository(repository),
+        root_dir(root_dir),
+        file_path(file_path),
+        cache(make_shared<ParseCache>())
+    {}
+
+    // Throws std::runtime_error if the file can not be loaded.
+    Version load(const string & revision)
+    {
+        Version version;
+        auto tree = make_shared<GitSourceTree>(repository, revision, root_dir);
+        version.commit = tree->commit();
+        if (tree->blob_id(file_path).empty())
+            throw std::runtime_error("File not found: " + file_path);
+        version.errors = make_shared<ErrorCollector>();
+        version.database = make_shared<GitDescriptorDatabase>(tree, cache, version.errors.get());
+
+        try
+        {
+            version.source = make_shared<Source>(file_path, version.database);
+        }
+        catch (SourceError &)
+        {
+            // Parse errors are collected by the database.
+            if (!version.errors->diagnostics().items.empty())
+                throw SourceError(version.errors->diagnostics());
+            throw;
+        }
+
+        return version;
+    }
+
+    size_t parsed_file_count() { return cache->size(); }
+
+private:
+    shared_ptr<GitRepository> repository;
+    string root_dir;
+    string file_path;
+    shared_ptr<ParseCache> cache;
+};
+
+// Versions which loaded the same files are identical.
+bool identical(const Version & a, const Version & b)
+{
+    return a.database->files() == b.database->files();
+}
+
+}
+
+int run_timeline(const string & range, const string & root_dir, const string & file_path,
+                 const vector<string> & selectors,
+                 const Comparison::Options & options)
+{
+    shared_ptr<GitRepository> repository;
+    vector<string> commits;
+
+    try
+    {
+        repository = GitRepository::open(".");
+        commits = repository->commits(range);
+    }
+    catch (std::exception & e)
+    {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    if (commits.empty())
+        return 0;
+
+    History history(repository, root_dir, file_path);
+
+    // The first commit is compared with its parent, if there is one
+    // and it has the file.
+    Version previous;
+
+    try
+    {
+        previous = history.load(commits.front() + "^");
+    }
+    catch (std::exception &)
+    {}
+
+    for (auto & commit : commits)
+    {
+        cout << commit.substr(0, 12) << " ";
+
+        Version current;
+
+        try
+        {
+            current = history.load(commit);
+        }
+        catch (std::exception & e)
+        {
+            cout << "error: " << e.what() << '\n';
+            continue;
+        }
+
+        if (!previous.source)
+        {
+            cout << "added" << '\n';
+        }
+        else if (identical(current, previous))
+        {
+            cout << "unchanged" << '\n';
+        }
+        else
+        {
+            Comparison comparison(options);
+            comparison.run(*previous.source, *current.source, selectors);
+
+            size_t count = comparison.root.item_count();
+            if (count)
+                cout << "changed: " << count << (count == 1 ? " difference" : " differences") << '\n';
+            else
+                cout << "compatible" << '\n';
+        }
+
+        previous = current;
+    }
+
+    cout.flush();
+
+    cerr << "Parsed " << history.parsed_file_count() << " file versions for "
+         << commits.size() << " commits." << endl;
+
+    return 0;
+}
+
+int run_bisect(const string & good, const string & bad,
+               const string & root_dir, const string & file_path,
+               const vector<string> & selectors,
+               const Comparison::Options & options)
+{
+    shared_ptr<GitRepository> repository;
+    vector<string> commits;
+
+    try
+    {
+        repository = GitRepository::open(".");
+        commits = repository->commits(good + ".." + bad);
+    }
+    catch (std::exception & e)
+    {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    History history(repository, root_dir, file_path);
+    Version baseline;
+
+    try
+    {
+        baseline = history.load(good);
+    }
+    catch (std::exception & e)
+    {
+        cerr << good << ": " << e.what() << endl;
+        return 1;
+    }
+
+    Comparison::Options probe_options = options;
+    probe_options.stop_at_first_difference = true;
+
+    size_t probe_count = 0;
+
+    // A commit is bad if it differs from the baseline,
+    // including when the file can not be loaded.
+    auto is_bad = [&](const string & commit)
+    {
+        ++probe_count;
+
+        Version version;
+
+        try
+        {
+            version = history.load(commit);
+        }
+        catch (std::exception & e)
+        {
+            cerr << commit.substr(0, 12) << " error: " << e.what() << endl;
+            return true;
+        }
+
+        bool bad = false;
+
+        if (!identical(version, baseline))
+        {
+            Comparison comparison(probe_options);
+            comparison.compare(*baseline.source, *version.source, selectors);
+            bad = comparison.root.has_changes();
+        }
+
+        cerr << commit.substr(0, 12) << (bad ? " bad" : " good") << endl;
+
+        return bad;
+    };
+
+    if (commits.empty() or !is_bad(commits.back()))
+    {
+        cout << "No incompatible commit between " << good << " and " << bad << "." << endl;
+        return 0;
+    }
+
+    // Invariant: commits[high] is bad, and commits before low are good.
+    size_t low = 0;
+    size_t high = commits.size() - 1;
+
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+        if (is_bad(commits[middle]))
+            high = middle;
+        else
+            low = middle + 1;
+    }
+
+    cout << "First incompatible commit: " << commits[high] << '\n';
+
+    Version first_bad;
+
+    try
+    {
+        first_bad = history.load(commits[high]);
+    }
+    catch (std::exception & e)
+    {
+        cout << e.what() << endl;
+        return 0;
+    }
+
+    Comparison comparison(options);
+    comparison.run(*baseline.source, *first_bad.source, selectors);
+    comparison.root.print();
+
+    cerr << "Tested " << probe_count << " of " << commits.size() << " commits." << endl;
+
+    return 0;
+}
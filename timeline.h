@@ -0,0 +1,33 @@
+#pragma once
+
+#include "comparison.h"
+
+#include <vector>
+
+// Walks the commits of a revision range in the git repository of the
+// current directory, oldest first, and reports for each commit whether
+// the selected types stayed compatible with the previous commit.
+//
+// root_dir is a directory within the repository and file_path is relative
+// to it. Parsed files are shared between commits by blob id, so each
+// distinct version of a file is parsed once. Commits which did not change
+// any loaded file are reported as unchanged without being compared.
+//
+// Returns 0 on success, 1 if the range could not be listed.
+int run_timeline(const string & range, const string & root_dir, const string & file_path,
+                 const vector<string> & selectors,
+                 const Comparison::Options & options);
+
+// Finds the first commit in good..bad (following first parents) where the
+// selected types differ from the good revision, by binary search.
+//
+// Each probe only checks for any difference and stops at the first one;
+// parsed files are shared between probes by blob id. The full report is
+// printed for the first bad commit only.
+//
+// Returns 0 on success, 1 if the range or the good revision could not be
+// loaded.
+int run_bisect(const string & good, const string & bad,
+               const string & root_dir, const string & file_path,
+               const vector<string> & selectors,
+               const Comparison::Options & options);
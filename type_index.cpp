@@ -0,0 +1,182 @@
+#include "type_index.h"
+
+#include <unordered_set>
+
+using namespace std;
+
+using google::protobuf::Descriptor;
+using google::protobuf::EnumDescriptor;
+using google::protobuf::FileDescriptor;
+
+static
+vector<string> split_name(const string & name)
+{
+    vector<string> components;
+    size_t start = 0;
+    while (true)
+    {
+        size_t end = name.find('.', start);
+        components.push_back(name.substr(start, end - start));
+        if (end == string::npos)
+            break;
+        start = end + 1;
+    }
+    return components;
+}
+
+// Matches a single name component against a pattern with '*' and '?'.
+static
+bool match_component(const char * pattern, const char * text)
+{
+    const char * star = nullptr;
+    const char * star_text = nullptr;
+
+    while (*text)
+    {
+        if (*pattern == '*')
+        {
+            star = pattern++;
+            star_text = text;
+        }
+        else if (*pattern == '?' or *pattern == *text)
+        {
+            ++pattern;
+            ++text;
+        }
+        else if (star)
+        {
+            pattern = star + 1;
+            text = ++star_text;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    while (*pattern == '*')
+        ++pattern;
+
+    return !*pattern;
+}
+
+TypeIndex::TypeIndex(const FileDescriptor * file)
+{
+    unordered_set<const FileDescriptor*> visited { file };
+    vector<const FileDescriptor*> files { file };
+
+    vector<const Descriptor*> messages;
+
+    while (!files.empty())
+    {
+        auto * f = files.back();
+        files.pop_back();
+
+        for (int i = 0; i < f->dependency_count(); ++i)
+        {
+            if (visited.insert(f->dependency(i)).second)
+                files.push_back(f->dependency(i));
+        }
+
+        for (int i = 0; i < f->message_type_count(); ++i)
+            messages.push_back(f->message_type(i));
+
+        for (int i = 0; i < f->enum_type_count(); ++i)
+            add(f->enum_type(i)->full_name());
+    }
+
+    while (!messages.empty())
+    {
+        auto * msg = messages.back();
+        messages.pop_back();
+
+        add(msg->full_name());
+
+        for (int i = 0; i < msg->nested_type_count(); ++i)
+            messages.push_back(msg->nested_type(i));
+
+        for (int i = 0; i < msg->enum_type_count(); ++i)
+            add(msg->enum_type(i)->full_name());
+    }
+}
+
+void TypeIndex::add(const string & full_name)
+{
+    int node = 0;
+    for (auto & component : split_name(full_name))
+    {
+        auto child = nodes[node].children.find(component);
+        if (child == nodes[node].children.end())
+        {
+            int id = int(nodes.size());
+            nodes[node].children.emplace(component, id);
+            nodes.emplace_back();
+            node = id;
+        }
+        else
+        {
+            node = child->second;
+        }
+    }
+
+    nodes[node].full_name = full_name;
+    nodes[node].is_type = true;
+}
+
+bool TypeIndex::is_pattern(const string & selector)
+{
+    return selector.find_first_of("*?") != string::npos;
+}
+
+vector<string> TypeIndex::match(const string & pattern) const
+{
+    vector<string> result;
+    match(0, split_name(pattern), 0, result);
+
+    unordered_set<string> seen;
+    vector<string> unique;
+    for (auto & name : result)
+    {
+        if (seen.insert(name).second)
+            unique.push_back(name);
+    }
+
+    return unique;
+}
+
+void TypeIndex::match(int node, const vector<string> & components, size_t component,
+                      vector<string> & result) const
+{
+    if (component == components.size())
+    {
+        if (nodes[node].is_type)
+            result.push_back(nodes[node].full_name);
+        return;
+    }
+
+    auto & pattern = components[component];
+    auto & children = nodes[node].children;
+
+    if (pattern == "**")
+    {
+        for (auto & child : children)
+        {
+            match(child.second, components, component + 1, result);
+            match(child.second, components, component, result);
+        }
+    }
+    else if (!is_pattern(pattern))
+    {
+        auto child = children.find(pattern);
+        if (child != children.end())
+            match(child->second, components, component + 1, result);
+    }
+    else
+    {
+        for (auto & child : children)
+        {
+            if (match_component(pattern.c_str(), child.first.c_str()))
+                match(child.second, components, component + 1, result);
+        }
+    }
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <google/protobuf/descriptor.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+using std::map;
+using std::string;
+using std::vector;
+
+// Index of the full names of all messages and enums (including nested ones)
+// in a file and the files it imports, stored as a trie of name components.
+//
+// Patterns select types by full name:
+// - '*' and '?' within a component match any characters except '.',
+// - a '**' component matches one or more whole components.
+// For example "corp.billing.**" selects every type nested in the package
+// corp.billing or its sub-packages.
+
+class TypeIndex
+{
+public:
+    TypeIndex(const google::protobuf::FileDescriptor * file);
+
+    // Full names of the types matching the pattern, in lexicographic order of
+    // components, each at most once.
+    vector<string> match(const string & pattern) const;
+
+    static bool is_pattern(const string & selector);
+
+private:
+    struct Node
+    {
+        map<string, int> children;
+        string full_name;
+        bool is_type = false;
+    };
+
+    void add(const string & full_name);
+    void match(int node, const vector<string> & components, size_t component,
+               vector<string> & result) const;
+
+    vector<Node> nodes { Node() };
+};
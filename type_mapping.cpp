@@ -0,0 +1,115 @@
+#include "type_mapping.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+TypeMapping TypeMapping::load(const string & path)
+{
+    ifstream file(path);
+    if (!file.is_open())
+        throw std::runtime_error("Failed to open type mapping file: " + path);
+
+    TypeMapping mapping;
+
+    string line;
+    int line_number = 0;
+    while (getline(file, line))
+    {
+        ++line_number;
+
+        istringstream words(line);
+        string kind, a, b, rest;
+        words >> kind;
+
+        if (kind.empty() or kind[0] == '#')
+            continue;
+
+        if (!(words >> a >> b) or (words >> rest and rest[0] != '#'))
+        {
+            throw std::runtime_error(path + ":" + to_string(line_number) +
+                                     ": Expected: exact|prefix|regex <first> <second>");
+        }
+
+        if (kind == "exact")
+        {
+            mapping.add_exact(a, b);
+        }
+        else if (kind == "prefix")
+        {
+            mapping.add_prefix(a, b);
+        }
+        else if (kind == "regex")
+        {
+            try
+            {
+                mapping.add_regex(a, b);
+            }
+            catch (std::regex_error & e)
+            {
+                throw std::runtime_error(path + ":" + to_string(line_number) +
+                                         ": Invalid regex: " + e.what());
+            }
+        }
+        else
+        {
+            throw std::runtime_error(path + ":" + to_string(line_number) +
+                                     ": Unknown rule: " + kind);
+        }
+    }
+
+    return mapping;
+}
+
+void TypeMapping::add_exact(const string & name1, const string & name2)
+{
+    exact[name1] = name2;
+}
+
+void TypeMapping::add_prefix(const string & prefix1, const string & prefix2)
+{
+    prefixes.emplace_back(prefix1, prefix2);
+
+    // Longest prefix first
+    stable_sort(prefixes.begin(), prefixes.end(),
+                [](const pair<string, string> & a, const pair<string, string> & b)
+    { return a.first.size() > b.first.size(); });
+}
+
+void TypeMapping::add_regex(const string & pattern, const string & replacement)
+{
+    regexes.push_back({ std::regex(pattern), replacement });
+}
+
+bool TypeMapping::map(const string & name1, string & name2) const
+{
+    auto e = exact.find(name1);
+    if (e != exact.end())
+    {
+        name2 = e->second;
+        return true;
+    }
+
+    for (auto & prefix : prefixes)
+    {
+        if (name1.compare(0, prefix.first.size(), prefix.first) == 0)
+        {
+            name2 = prefix.second + name1.substr(prefix.first.size());
+            return true;
+        }
+    }
+
+    for (auto & rule : regexes)
+    {
+        if (std::regex_match(name1, rule.pattern))
+        {
+            name2 = std::regex_replace(name1, rule.pattern, rule.replacement);
+            return true;
+        }
+    }
+
+    return false;
+}
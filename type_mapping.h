@@ -0,0 +1,53 @@
+#pragma once
+
+#include <regex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using std::string;
+using std::unordered_map;
+using std::vector;
+
+// Rules pairing full type names of the first side with names on the second
+// side, e.g. for a migration of corp.v1.* to corp.v2.*.
+//
+// A mapping file has one rule per line; empty lines and lines starting
+// with '#' are ignored:
+//
+//     exact  corp.v1.Old  corp.v2.New
+//     prefix corp.v1.     corp.v2.
+//     regex  ^corp\.v1\.(\w+)Request$  corp.v2.$1Req
+//
+// Exact rules take precedence, then the longest matching prefix,
+// then regex rules in the order given.
+
+class TypeMapping
+{
+public:
+    TypeMapping() {}
+
+    // Throws std::runtime_error if the file can not be read or has syntax errors.
+    static TypeMapping load(const string & path);
+
+    void add_exact(const string & name1, const string & name2);
+    void add_prefix(const string & prefix1, const string & prefix2);
+    void add_regex(const string & pattern, const string & replacement);
+
+    // Sets name2 to the counterpart of name1 and returns true
+    // if any rule applies to name1.
+    bool map(const string & name1, string & name2) const;
+
+    bool empty() const { return exact.empty() and prefixes.empty() and regexes.empty(); }
+
+private:
+    struct RegexRule
+    {
+        std::regex pattern;
+        string replacement;
+    };
+
+    unordered_map<string, string> exact;
+    vector<std::pair<string, string>> prefixes;
+    vector<RegexRule> regexes;
+};
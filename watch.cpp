@@ -0,0 +1,443 @@
+#include "watch.h"
+#include "mapped_source_tree.h"
+
+#include <google/protobuf/descriptor.pb.h>
+#include <google/protobuf/descriptor_database.h>
+
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <set>
+
+using namespace std;
+
+using google::protobuf::DescriptorDatabase;
+using google::protobuf::FileDescriptorProto;
+using google::protobuf::compiler::MultiFileErrorCollector;
+using google::protobuf::compiler::SourceTree;
+using google::protobuf::compiler::SourceTreeDescriptorDatabase;
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Changes are collected until none arrive for this long, so that
+// saving several files, or one file in several steps, gives one update.
+const int quiet_period_ms = 20;
+
+// Whether two parsed files differ only in source locations and comments.
+bool same_definitions(const FileDescriptorProto & a, const FileDescriptorProto & b)
+{
+    FileDescriptorProto a_definitions = a;
+    FileDescriptorProto b_definitions = b;
+    a_definitions.clear_source_code_info();
+    b_definitions.clear_source_code_info();
+    return a_definitions.SerializeAsString() == b_definitions.SerializeAsString();
+}
+
+// Descriptor database over files on disk, which keeps the parsed files
+// until they are updated.
+
+class WatchedDatabase : public DescriptorDatabase
+{
+public:
+    WatchedDatabase(const vector<string> & roots):
+        roots(roots)
+    {}
+
+    // Starts recording the files provided to a new load, with parse
+    // errors going to errors.
+    void begin_load(MultiFileErrorCollector * errors)
+    {
+        this->errors = errors;
+        d_files.clear();
+    }
+
+    bool FindFileByName(const string & filename, FileDescriptorProto * output) override
+    {
+        auto file = parsed.find(filename);
+
+        if (file == parsed.end())
+        {
+            auto parsed_file = parse(filename, errors);
+            if (!parsed_file)
+                return false;
+            file = parsed.emplace(filename, parsed_file).first;
+        }
+
+        d_files.insert(filename);
+        *output = *file->second;
+
+        return true;
+    }
+
+    // Files are only found by name; symbols are resolved by the pool.
+    bool FindFileContainingSymbol(const string &, FileDescriptorProto *) override { return false; }
+    bool FindFileContainingExtension(const string &, int, FileDescriptorProto *) override { return false; }
+
+    // Reparses a changed file. Returns true if the last load used the file
+    // and it now parses to different definitions, or not at all.
+    bool update(const string & filename)
+    {
+        // The tree may hold mappings of old file versions.
+        tree.reset();
+
+        auto file = parsed.find(filename);
+        if (file == parsed.end())
+            return false;
+
+        if (!d_files.count(filename))
+        {
+            parsed.erase(file);
+            return false;
+        }
+
+        auto reparsed = parse(filename, nullptr);
+        if (reparsed and same_definitions(*reparsed, *file->second))
+            return false;
+
+        if (reparsed)
+            file->second = reparsed;
+        else
+            parsed.erase(file);
+
+        return true;
+    }
+
+    // Number of times a file was parsed.
+    size_t parsed_count() const { return d_parsed_count; }
+
+private:
+    shared_ptr<const FileDescriptorProto> parse(const string & filename, MultiFileErrorCollector * errors)
+    {
+        if (!tree)
+            tree = open_source_tree(roots);
+
+        SourceTreeDescriptorDatabase parser(tree.get());
+        parser.RecordErrorsTo(errors);
+        ++d_parsed_count;
+
+        auto file = make_shared<FileDescriptorProto>();
+        if (!parser.FindFileByName(filename, file.get()))
+            return nullptr;
+
+        return file;
+    }
+
+    vector<string> roots;
+    shared_ptr<SourceTree> tree;
+    MultiFileErrorCollector * errors = nullptr;
+    map<string, shared_ptr<const FileDescriptorProto>> parsed;
+    set<string> d_files;
+    size_t d_parsed_count = 0;
+};
+
+// Watches directory trees with inotify.
+
+class Watcher
+{
+public:
+    Watcher():
+        fd(inotify_init1(IN_CLOEXEC))
+    {}
+
+    ~Watcher()
+    {
+        if (fd >= 0)
+            close(fd);
+    }
+
+    Watcher(const Watcher &) = delete;
+    Watcher & operator=(const Watcher &) = delete;
+
+    // Watches dir and all directories under it.
+    // Returns false if dir can not be watched.
+    bool add(const string & dir)
+    {
+        if (!add_directory(dir))
+            return false;
+
+        error_code error;
+        for (fs::recursive_directory_iterator entry(dir, fs::directory_options::skip_permission_denied, error), end;
+             entry != end; entry.increment(error))
+        {
+            if (entry->is_directory(error))
+                add_directory(entry->path().string());
+        }
+
+        return true;
+    }
+
+    // Waits for changes, and collects the paths of changed files until no
+    // more changes arrive for quiet_ms. Returns false if waiting failed.
+    bool wait(set<string> & changed, int quiet_ms)
+    {
+        int timeout = -1;
+
+        while (true)
+        {
+            pollfd request { fd, POLLIN, 0 };
+            int ready = poll(&request, 1, timeout);
+            if (ready < 0 and errno == EINTR)
+                continue;
+            if (ready < 0)
+                return false;
+            if (ready == 0)
+                return true;
+
+            alignas(inotify_event) char buffer[64 * 1024];
+            ssize_t length = read(fd, buffer, sizeof(buffer));
+            if (length < 0 and errno == EINTR)
+                continue;
+            if (length <= 0)
+                return false;
+
+            for (char * position = buffer; position < buffer + length; )
+            {
+                auto * event = reinterpret_cast<inotify_event*>(position);
+                position += sizeof(inotify_event) + event->len;
+
+                auto dir = directories.find(event->wd);
+                if (dir == directories.end())
+                    continue;
+
+                if (event->mask & IN_IGNORED)
+                {
+                    directories.erase(dir);
+                    continue;
+                }
+
+                if (!event->len)
+                    continue;
+
+                string path = dir->second + "/" + event->name;
+
+                if (event->mask & IN_ISDIR)
+                {
+                    if (event->mask & (IN_CREATE | IN_MOVED_TO))
+                        add(path);
+                    continue;
+                }
+
+                changed.insert(path);
+            }
+
+            timeout = quiet_ms;
+        }
+    }
+
+private:
+    bool add_directory(const string & dir)
+    {
+        if (fd < 0)
+            return false;
+
+        int wd = inotify_add_watch(fd, dir.c_str(),
+                                   IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO);
+        if (wd < 0)
+            return false;
+
+        directories[wd] = dir;
+        return true;
+    }
+
+    int fd;
+    // Watch descriptor -> directory.
+    map<int, string> directories;
+};
+
+}
+
+struct WatchSession::Side
+{
+    Side(const vector<string> & roots, const string & file):
+        roots(roots),
+        file(file),
+        database(make_shared<WatchedDatabase>(roots))
+    {}
+
+    // Notes a changed path on disk, if the roots contain it.
+    void note_change(const string & path)
+    {
+        for (auto & root : roots)
+        {
+            if (!fs::is_directory(root))
+                continue;
+
+            auto relative = fs::path(path).lexically_normal()
+                .lexically_relative(fs::path(root).lexically_normal()).generic_string();
+            if (!relative.empty() and relative != "." and relative.compare(0, 2, "..") != 0)
+                dirty.insert(relative);
+        }
+    }
+
+    vector<string> roots;
+    string file;
+    shared_ptr<WatchedDatabase> database;
+    shared_ptr<ErrorCollector> errors;
+    shared_ptr<Source> source;
+    // Changed paths relative to the roots.
+    set<string> dirty;
+};
+
+WatchSession::WatchSession(const vector<string> & roots1, const string & file1,
+                           const vector<string> & roots2, const string & file2,
+                           const vector<string> & selectors,
+                           const Comparison::Options & options,
+                           ostream & out, ostream & log):
+    selectors(selectors),
+    options(options),
+    out(out),
+    log(log)
+{
+    sides[0] = make_unique<Side>(roots1, file1);
+    sides[1] = make_unique<Side>(roots2, file2);
+
+    for (auto & side : sides)
+        load(*side);
+    report();
+}
+
+WatchSession::~WatchSession() = default;
+
+vector<string> WatchSession::directories() const
+{
+    vector<string> directories;
+
+    for (auto & side : sides)
+    {
+        for (auto & root : side->roots)
+        {
+            if (fs::is_directory(root))
+                directories.push_back(root);
+        }
+    }
+
+    return directories;
+}
+
+size_t WatchSession::parsed_count() const
+{
+    return sides[0]->database->parsed_count() + sides[1]->database->parsed_count();
+}
+
+bool WatchSession::update(const set<string> & changed)
+{
+    bool reloaded = false;
+
+    for (auto & side : sides)
+    {
+        side->dirty.clear();
+        for (auto & path : changed)
+            side->note_change(path);
+
+        if (side->dirty.empty())
+            continue;
+
+        // After a failed load, any change may fix it.
+        bool stale = !side->source;
+        for (auto & path : side->dirty)
+        {
+            if (side->database->update(path))
+                stale = true;
+        }
+
+        if (stale)
+        {
+            load(*side);
+            reloaded = true;
+        }
+    }
+
+    return reloaded and report();
+}
+
+// Loads the file of a side from its database, logging any diagnostics.
+void WatchSession::load(Side & side)
+{
+    side.errors = make_shared<ErrorCollector>();
+    side.database->begin_load(side.errors.get());
+    side.source.reset();
+
+    try
+    {
+        side.source = make_shared<Source>(side.file, side.database);
+    }
+    catch (SourceError & e)
+    {
+        // Parse errors are collected by the database.
+        if (!side.errors->diagnostics().items.empty())
+            side.errors->diagnostics().print(log);
+        else
+            log << e.what() << endl;
+        return;
+    }
+
+    if (!side.errors->diagnostics().items.empty())
+        side.errors->diagnostics().print(log);
+}
+
+bool WatchSession::report()
+{
+    if (!sides[0]->source or !sides[1]->source)
+        return false;
+
+    Comparison comparison(options);
+    comparison.run(*sides[0]->source, *sides[1]->source, selectors);
+    comparison.root.print(out);
+    out.flush();
+    return true;
+}
+
+int run_watch(const vector<string> & roots1, const string & file1,
+              const vector<string> & roots2, const string & file2,
+              const vector<string> & selectors,
+              const Comparison::Options & options)
+{
+    // Watched files are edited while they are held.
+    MappedFile::copy_files(true);
+
+    WatchSession session(roots1, file1, roots2, file2, selectors, options, cout, cerr);
+
+    Watcher watcher;
+    bool watching = false;
+
+    for (auto & directory : session.directories())
+    {
+        if (watcher.add(directory))
+            watching = true;
+    }
+
+    if (!watching)
+    {
+        cerr << "No directory root can be watched." << endl;
+        return 1;
+    }
+
+    while (true)
+    {
+        set<string> changed;
+        if (!watcher.wait(changed, quiet_period_ms))
+        {
+            cerr << "Failed to watch for changes." << endl;
+            return 1;
+        }
+
+        auto start = chrono::steady_clock::now();
+        size_t parsed = session.parsed_count();
+
+        if (!session.update(changed))
+            continue;
+
+        auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start);
+        parsed = session.parsed_count() - parsed;
+        cerr << "Updated in " << elapsed.count() << " ms, parsed " << parsed
+             << (parsed == 1 ? " file." : " files.") << endl;
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "comparison.h"
+
+#include <memory>
+#include <ostream>
+#include <set>
+#include <vector>
+
+// Compares file1 (searched in roots1) with file2 (searched in roots2) and
+// keeps both sides loaded, to compare them again after files change.
+//
+// Parsed files are kept between updates, so a change reparses only the
+// changed files. A side is reloaded only if a changed file parses
+// differently, not counting source locations and comments (so edits of
+// comments or layout do not count), and the types are compared again only
+// if a side was reloaded.
+
+class WatchSession
+{
+public:
+    // Loads both sides and writes the first report to out.
+    // Diagnostics go to log.
+    WatchSession(const vector<string> & roots1, const string & file1,
+                 const vector<string> & roots2, const string & file2,
+                 const vector<string> & selectors,
+                 const Comparison::Options & options,
+                 std::ostream & out, std::ostream & log);
+    ~WatchSession();
+
+    // Directory roots of both sides; archive and git roots do not change.
+    vector<string> directories() const;
+
+    // Takes the paths of changed files on disk, and writes a new report if
+    // a side was reloaded. Returns whether it wrote one.
+    bool update(const std::set<string> & changed);
+
+    // Number of times a file was parsed.
+    size_t parsed_count() const;
+
+private:
+    struct Side;
+
+    void load(Side & side);
+    // Returns false if a side failed to load.
+    bool report();
+
+    vector<string> selectors;
+    Comparison::Options options;
+    std::ostream & out;
+    std::ostream & log;
+    std::unique_ptr<Side> sides[2];
+};
+
+// Runs a WatchSession on the standard output, and watches its directories
+// for changes with inotify. Prints the time of each update. Runs until
+// killed.
+//
+// Returns 1 if no root can be watched.
+int run_watch(const vector<string> & roots1, const string & file1,
+              const vector<string> & roots2, const string & file2,
+              const vector<string> & selectors,
+              const Comparison::Options & options);